@@ -4,59 +4,132 @@
 #include <GLFW/glfw3.h>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <iostream>
+
+// 12 edges of the cube [-1,1]^3 as line segments; grid.vs scales them by the
+// oct half-size and moves them to the oct centre
+static const GLfloat s_unitCubeLines[24 * 3] = {
+  -1,-1,-1,  1,-1,-1,   1,-1,-1,  1, 1,-1,   1, 1,-1, -1, 1,-1,  -1, 1,-1, -1,-1,-1,
+  -1,-1, 1,  1,-1, 1,   1,-1, 1,  1, 1, 1,   1, 1, 1, -1, 1, 1,  -1, 1, 1, -1,-1, 1,
+  -1,-1,-1, -1,-1, 1,   1,-1,-1,  1,-1, 1,   1, 1,-1,  1, 1, 1,  -1, 1,-1, -1, 1, 1
+};
 
 AMRGridRenderer::AMRGridRenderer(const std::string& infoFilePath) {
   m_snap = std::make_unique<RAMSES::snapshot>(infoFilePath, RAMSES::version3);
   m_shader = std::make_unique<Shader>("./resources/shaders/grid.vs", "./resources/shaders/grid.frag");
 
   glGenVertexArrays(1, &m_vao);
-  glGenBuffers(1, &m_vbo);
+  glGenBuffers(1, &m_cubeVbo);
+  glGenBuffers(1, &m_instanceVbo);
+
+  glBindVertexArray(m_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, m_cubeVbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(s_unitCubeLines), s_unitCubeLines, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(OctInstance), (void*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(1, 1);
+  glBindVertexArray(0);
 }
 
 AMRGridRenderer::~AMRGridRenderer() {
-  if (m_vbo) glDeleteBuffers(1, &m_vbo);
+  if (m_instanceVbo) glDeleteBuffers(1, &m_instanceVbo);
+  if (m_cubeVbo) glDeleteBuffers(1, &m_cubeVbo);
   if (m_vao) glDeleteVertexArrays(1, &m_vao);
 }
 
-void AMRGridRenderer::appendBoxLines(const glm::vec3& minp, const glm::vec3& maxp, std::vector<glm::vec3>& out) {
-  glm::vec3 v[8] = {
-    {minp.x, minp.y, minp.z}, {maxp.x, minp.y, minp.z}, {maxp.x, maxp.y, minp.z}, {minp.x, maxp.y, minp.z},
-    {minp.x, minp.y, maxp.z}, {maxp.x, minp.y, maxp.z}, {maxp.x, maxp.y, maxp.z}, {minp.x, maxp.y, maxp.z}
-  };
-  int e[12][2] = {{0,1},{1,2},{2,3},{3,0},{4,5},{5,6},{6,7},{7,4},{0,4},{1,5},{2,6},{3,7}};
-  for (int i=0;i<12;++i){ out.push_back(v[e[i][0]]); out.push_back(v[e[i][1]]);} }
-
 void AMRGridRenderer::build(unsigned minLevel, unsigned maxLevel) {
   // Build AMR tree for a single domain at a time (domain 1 here for simplicity)
-  unsigned ilevelMax = std::min<unsigned>(maxLevel, m_snap->m_header.levelmax);
-  RAMSES::AMR::tree<RAMSES::AMR::cell_locally_essential<>, RAMSES::AMR::level<RAMSES::AMR::cell_locally_essential<>>> tree(*m_snap, 1, ilevelMax, minLevel);
-  tree.read();
-
-  std::vector<glm::vec3> lineVerts;
-  // Iterate levels and add each cell's AABB as lines
-  for (unsigned lvl=minLevel; lvl<=ilevelMax; ++lvl) {
-    for (auto it = tree.begin(lvl); it != tree.end(lvl); ++it) {
-      auto gc = tree.grid_pos<float>(it);
-      glm::vec3 gc3(gc.x, gc.y, gc.z);
-      float dx2 = 0.5f / std::pow(2.0f, (float)lvl);
-      glm::vec3 minp = gc3 - glm::vec3(dx2);
-      glm::vec3 maxp = gc3 + glm::vec3(dx2);
-      appendBoxLines(minp, maxp, lineVerts);
+  unsigned ilevelMax = std::min<unsigned>(maxLevel, m_snap->m_header.levelmax - 1);
+  m_tree = std::make_unique<Tree>(*m_snap, 1, ilevelMax, minLevel);
+  // Decoded tree is cached next to the amr file, later launches skip parsing it
+  if (m_tree->read_cached(m_tree->default_cache_fname()))
+    std::cout << "AMRGridRenderer: AMR tree restored from cache" << std::endl;
+
+  m_minLevel = minLevel;
+  m_numInstances = 0;
+  m_dirty = true;
+}
+
+void AMRGridRenderer::selectVisible(const glm::mat4& view, const glm::mat4& proj, float viewportHeight) {
+  m_instances.clear();
+
+  // Frustum planes (Gribb/Hartmann) from the rows of the clip matrix,
+  // inside where dot(plane.xyz, p) + plane.w >= 0
+  glm::mat4 clip = proj * view;
+  glm::vec4 row[4];
+  for (int i=0;i<4;++i) row[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+  glm::vec4 planes[6] = { row[3]+row[0], row[3]-row[0], row[3]+row[1], row[3]-row[1], row[3]+row[2], row[3]-row[2] };
+
+  // pixels covered by a unit length at unit eye distance
+  float pixelsPerUnit = 0.5f * viewportHeight * proj[1][1];
+
+  struct Node { unsigned level, index; };
+  std::vector<Node> stack;
+  for (unsigned i=0; i<m_tree->m_AMR_levels[0].size(); ++i)
+    stack.push_back(Node{0, i});
+
+  while (!stack.empty()) {
+    Node n = stack.back();
+    stack.pop_back();
+
+    const Cell& oct = m_tree->m_AMR_levels[n.level][n.index];
+    glm::vec3 c(oct.m_xg[0], oct.m_xg[1], oct.m_xg[2]);
+    float h = std::ldexp(1.0f, -(int)n.level - 1);
+
+    // Reject the subtree if the oct box lies outside any frustum plane
+    bool outside = false;
+    for (int p=0; p<6 && !outside; ++p) {
+      glm::vec3 pn(planes[p].x, planes[p].y, planes[p].z);
+      float r = h * (std::fabs(pn.x) + std::fabs(pn.y) + std::fabs(pn.z));
+      outside = glm::dot(pn, c) + planes[p].w < -r;
     }
-  }
+    if (outside) continue;
 
-  m_numLines = lineVerts.size() / 2;
+    // Projected size; children are half as large, so stop once sub-threshold
+    glm::vec4 ce = view * glm::vec4(c, 1.0f);
+    float dist = std::max(glm::length(glm::vec3(ce.x, ce.y, ce.z)) - 1.7320508f * h, 1e-6f);
+    if (2.0f * h * pixelsPerUnit / dist < m_pixelThreshold) continue;
 
-  glBindVertexArray(m_vao);
-  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-  glBufferData(GL_ARRAY_BUFFER, lineVerts.size() * sizeof(glm::vec3), lineVerts.data(), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-  glEnableVertexAttribArray(0);
-  glBindVertexArray(0);
+    if (n.level >= m_minLevel)
+      m_instances.push_back(OctInstance(c.x, c.y, c.z, (float)n.level));
+
+    if ((int)n.level >= m_tree->m_maxlevel) continue;
+    const unsigned nchild = m_tree->m_AMR_levels[n.level+1].size();
+    for (unsigned k=0; k<8; ++k)
+      if (oct.is_refined(k) && oct.m_son[k] < nchild)
+        stack.push_back(Node{n.level+1, oct.m_son[k]});
+  }
 }
 
 void AMRGridRenderer::draw(const glm::mat4& view, const glm::mat4& proj) {
-  if (!m_visible || m_numLines == 0) return;
+  if (!m_visible || !m_tree) return;
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if (m_dirty || std::memcmp(&view, &m_lastView, sizeof(glm::mat4)) != 0
+      || std::memcmp(&proj, &m_lastProj, sizeof(glm::mat4)) != 0
+      || std::memcmp(viewport, m_lastViewport, sizeof(viewport)) != 0) {
+    selectVisible(view, proj, (float)viewport[3]);
+    m_numInstances = m_instances.size();
+
+    // orphan the previous buffer so the upload does not wait on the last draw
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(OctInstance), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_instances.size() * sizeof(OctInstance), m_instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_lastView = view;
+    m_lastProj = proj;
+    std::memcpy(m_lastViewport, viewport, sizeof(viewport));
+    m_dirty = false;
+  }
+  if (m_numInstances == 0) return;
+
   m_shader->Use();
   GLint viewLoc = glGetUniformLocation(m_shader->Program, "view");
   GLint projLoc = glGetUniformLocation(m_shader->Program, "projection");
@@ -66,6 +139,6 @@ void AMRGridRenderer::draw(const glm::mat4& view, const glm::mat4& proj) {
   glUniform3f(colorLoc, 0.15f, 0.8f, 0.2f); // greenish grid
 
   glBindVertexArray(m_vao);
-  glDrawArrays(GL_LINES, 0, (GLsizei)(m_numLines * 2));
+  glDrawArraysInstanced(GL_LINES, 0, 24, (GLsizei)m_numInstances);
   glBindVertexArray(0);
 }
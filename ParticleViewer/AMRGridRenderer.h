@@ -11,13 +11,22 @@
 #include <glm/glm.hpp>
 
 // Simple AMR grid wireframe renderer. Loads amr_* from the same snapshot
-// path (from info_XXXXX.txt) and draws child cell centers as lines/boxes.
+// path (from info_XXXXX.txt) and draws every oct as a wireframe box.
+// A single unit cube is expanded per oct in grid.vs (instanced drawing),
+// so each oct only costs one compact instance record on the GPU.
+//
+// Octs are selected per view: the tree is walked top-down through the son
+// links and a subtree is dropped as soon as it leaves the view frustum or
+// its octs project to fewer than pixelThreshold() pixels.
 class AMRGridRenderer {
 public:
+  typedef RAMSES::AMR::cell_locally_essential<> Cell;
+  typedef RAMSES::AMR::tree<Cell, RAMSES::AMR::level<Cell>> Tree;
+
   explicit AMRGridRenderer(const std::string& infoFilePath);
   ~AMRGridRenderer();
 
-  // Build line geometry for a subset of levels [minLevel, maxLevel]
+  // Load the AMR tree; octs on levels [minLevel, maxLevel] may be drawn
   void build(unsigned minLevel, unsigned maxLevel);
 
   // Draw with provided view/projection matrices
@@ -27,18 +36,36 @@ public:
   void setVisible(bool v) { m_visible = v; }
   bool isVisible() const { return m_visible; }
 
+  // Smallest projected oct size (in pixels) that is still drawn
+  void setPixelThreshold(float px) { m_pixelThreshold = px; m_dirty = true; }
+  float pixelThreshold() const { return m_pixelThreshold; }
+
 private:
   bool m_visible{false};
 
-  // GL resources
-  unsigned int m_vao{0}, m_vbo{0};
-  size_t m_numLines{0};
+  // GL resources: m_cubeVbo holds the 24 unit cube line vertices,
+  // m_instanceVbo one OctInstance per visible oct
+  unsigned int m_vao{0}, m_cubeVbo{0}, m_instanceVbo{0};
+  size_t m_numInstances{0};
 
   std::unique_ptr<RAMSES::snapshot> m_snap;
+  std::unique_ptr<Tree> m_tree;
+  unsigned m_minLevel{0};
 
   // Minimal shader for grid lines
   std::unique_ptr<Shader> m_shader; // expects grid.vs/grid.frag
 
-  // Helper: add AABB as 12 line segments
-  void appendBoxLines(const glm::vec3& minp, const glm::vec3& maxp, std::vector<glm::vec3>& out);
+  // Per-oct instance record: oct centre (xyz) and tree level (w), 16 bytes
+  // instead of 24 line vertices (288 bytes) per oct
+  typedef glm::vec4 OctInstance;
+  std::vector<OctInstance> m_instances;
+
+  // LOD state; the selection is only redone when the camera or viewport changes
+  float m_pixelThreshold{4.0f};
+  bool m_dirty{true};
+  glm::mat4 m_lastView, m_lastProj;
+  int m_lastViewport[4]{0, 0, 0, 0};
+
+  // Walk the tree and collect the octs visible from the given camera
+  void selectVisible(const glm::mat4& view, const glm::mat4& proj, float viewportHeight);
 };
@@ -0,0 +1,166 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+uint32_t crcTable(int n) {
+  uint32_t c = uint32_t(n);
+  for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+  return c;
+}
+
+// CRC-32 as used by PNG chunks
+struct Crc32 {
+  uint32_t table[256];
+  Crc32() { for (int n = 0; n < 256; ++n) table[n] = crcTable(n); }
+  uint32_t update(uint32_t crc, const uint8_t* buf, size_t len) const {
+    for (size_t i = 0; i < len; ++i) crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+  }
+};
+
+// Writes a chunk payload while keeping the running CRC of type + data
+class ChunkWriter {
+public:
+  ChunkWriter(std::ofstream& out, const Crc32& crc) : m_out(out), m_table(crc) {}
+
+  void begin(uint32_t length, const char* type) {
+    putBE(length);
+    m_crc = 0xffffffffu;
+    put(reinterpret_cast<const uint8_t*>(type), 4);
+  }
+  void put(const uint8_t* data, size_t len) {
+    m_out.write(reinterpret_cast<const char*>(data), std::streamsize(len));
+    m_crc = m_table.update(m_crc, data, len);
+  }
+  void put8(uint8_t v) { put(&v, 1); }
+  void put32(uint32_t v) { uint8_t b[4] = { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) }; put(b, 4); }
+  void end() { putBE(m_crc ^ 0xffffffffu); }
+
+private:
+  void putBE(uint32_t v) {
+    uint8_t b[4] = { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) };
+    m_out.write(reinterpret_cast<const char*>(b), 4);
+  }
+
+  std::ofstream& m_out;
+  const Crc32& m_table;
+  uint32_t m_crc{0};
+};
+
+} // namespace
+
+void Image::resize(int width, int height) {
+  m_width = std::max(0, width);
+  m_height = std::max(0, height);
+  m_rgb.assign(size_t(m_width) * m_height * 3, 0);
+}
+
+void Image::setPixel(int x, int y, float r, float g, float b) {
+  uint8_t* p = pixel(x, y);
+  p[0] = uint8_t(std::min(std::max(r, 0.0f), 1.0f) * 255.0f + 0.5f);
+  p[1] = uint8_t(std::min(std::max(g, 0.0f), 1.0f) * 255.0f + 0.5f);
+  p[2] = uint8_t(std::min(std::max(b, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+void Image::flipVertical() {
+  size_t rowBytes = size_t(m_width) * 3;
+  for (int y = 0; y < m_height / 2; ++y)
+    std::swap_ranges(m_rgb.begin() + y * rowBytes, m_rgb.begin() + (y + 1) * rowBytes,
+                     m_rgb.begin() + (m_height - 1 - y) * rowBytes);
+}
+
+bool Image::writePPM(const std::string& path) const {
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "Image: unable to open '" << path << "' for writing" << std::endl;
+    return false;
+  }
+  out << "P6\n" << m_width << " " << m_height << "\n255\n";
+  out.write(reinterpret_cast<const char*>(m_rgb.data()), std::streamsize(m_rgb.size()));
+  return bool(out);
+}
+
+bool Image::writePNG(const std::string& path) const {
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "Image: unable to open '" << path << "' for writing" << std::endl;
+    return false;
+  }
+
+  static const Crc32 crc;
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  out.write(reinterpret_cast<const char*>(signature), 8);
+
+  ChunkWriter chunk(out, crc);
+  chunk.begin(13, "IHDR");
+  chunk.put32(uint32_t(m_width));
+  chunk.put32(uint32_t(m_height));
+  const uint8_t ihdr[5] = { 8, 2, 0, 0, 0 }; // 8 bit RGB, deflate, no filter, no interlace
+  chunk.put(ihdr, 5);
+  chunk.end();
+
+  // Filtered scanlines (filter type 0) packed into stored deflate blocks
+  const size_t rowBytes = size_t(m_width) * 3;
+  const uint64_t rawSize = uint64_t(rowBytes + 1) * m_height;
+  const uint64_t maxBlock = 65535;
+  const uint64_t numBlocks = std::max<uint64_t>(1, (rawSize + maxBlock - 1) / maxBlock);
+  const uint64_t idatSize = 2 + numBlocks * 5 + rawSize + 4;
+  if (idatSize > 0x7fffffffu) {
+    std::cerr << "Image: '" << path << "' is too large for a single PNG data chunk" << std::endl;
+    return false;
+  }
+
+  chunk.begin(uint32_t(idatSize), "IDAT");
+  chunk.put8(0x78);
+  chunk.put8(0x01);
+
+  uint32_t adlerA = 1, adlerB = 0;
+  uint64_t blockLeft = 0, written = 0;
+  auto emit = [&](const uint8_t* data, size_t len) {
+    while (len > 0) {
+      if (blockLeft == 0) {
+        blockLeft = std::min(maxBlock, rawSize - written);
+        uint16_t n = uint16_t(blockLeft), nn = uint16_t(~n);
+        uint8_t hdr[5] = { uint8_t(written + blockLeft == rawSize ? 1 : 0),
+                           uint8_t(n), uint8_t(n >> 8), uint8_t(nn), uint8_t(nn >> 8) };
+        chunk.put(hdr, 5);
+      }
+      size_t part = size_t(std::min<uint64_t>(len, blockLeft));
+      chunk.put(data, part);
+      for (size_t i = 0; i < part; ++i) {
+        adlerA = (adlerA + data[i]) % 65521u;
+        adlerB = (adlerB + adlerA) % 65521u;
+      }
+      data += part;
+      len -= part;
+      blockLeft -= part;
+      written += part;
+    }
+  };
+
+  const uint8_t filter = 0;
+  for (int y = 0; y < m_height; ++y) {
+    emit(&filter, 1);
+    emit(m_rgb.data() + y * rowBytes, rowBytes);
+  }
+  if (rawSize == 0) {
+    const uint8_t empty[5] = { 1, 0, 0, 0xff, 0xff };
+    chunk.put(empty, 5);
+  }
+  chunk.put32((adlerB << 16) | adlerA);
+  chunk.end();
+
+  chunk.begin(0, "IEND");
+  chunk.end();
+  return bool(out);
+}
+
+bool Image::write(const std::string& path) const {
+  std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : std::string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == ".ppm" ? writePPM(path) : writePNG(path);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 8-bit RGB image with rows stored top-down, written as binary PPM or PNG.
+// The PNG writer emits stored (uncompressed) deflate blocks, so it needs no
+// zlib and streams rows straight to disk, which keeps large images cheap.
+class Image {
+public:
+  Image() {}
+  Image(int width, int height) { resize(width, height); }
+
+  void resize(int width, int height);
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+
+  uint8_t* pixel(int x, int y) { return &m_rgb[3 * (size_t(y) * m_width + x)]; }
+  const uint8_t* pixel(int x, int y) const { return &m_rgb[3 * (size_t(y) * m_width + x)]; }
+
+  // Colour components in [0,1], clamped
+  void setPixel(int x, int y, float r, float g, float b);
+
+  // OpenGL read-backs are bottom-up
+  void flipVertical();
+
+  std::vector<uint8_t>& data() { return m_rgb; }
+  const std::vector<uint8_t>& data() const { return m_rgb; }
+
+  bool writePPM(const std::string& path) const;
+  bool writePNG(const std::string& path) const;
+  // Picks the format from the extension (.ppm, otherwise PNG)
+  bool write(const std::string& path) const;
+
+private:
+  int m_width{0}, m_height{0};
+  std::vector<uint8_t> m_rgb;
+};
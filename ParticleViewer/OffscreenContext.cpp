@@ -0,0 +1,122 @@
+#include "OffscreenContext.h"
+
+#include <stdexcept>
+
+#ifdef PARTICLEVIEWER_EGL
+#include <EGL/eglext.h>
+#endif
+
+namespace {
+
+#ifdef PARTICLEVIEWER_EGL
+// Mesa's surfaceless platform needs no window system at all; other EGL
+// implementations fall back to their default display
+EGLDisplay openDisplay() {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay) {
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display != EGL_NO_DISPLAY)
+      return display;
+  }
+#endif
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
+
+}  // namespace
+
+OffscreenContext::OffscreenContext(int width, int height) : m_width(width), m_height(height) {
+  if (width <= 0 || height <= 0)
+    throw std::runtime_error("OffscreenContext: invalid framebuffer size");
+
+#ifdef PARTICLEVIEWER_EGL
+  m_display = openDisplay();
+  EGLint major, minor;
+  if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor))
+    throw std::runtime_error("OffscreenContext: cannot initialise EGL");
+  eglBindAPI(EGL_OPENGL_API);
+
+  const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config = nullptr;
+  EGLint numConfigs = 0;
+  eglChooseConfig(m_display, configAttribs, &config, 1, &numConfigs);
+#ifdef EGL_NO_CONFIG_KHR
+  if (numConfigs == 0)
+    config = EGL_NO_CONFIG_KHR;
+#endif
+
+  const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+  m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
+  // Rendering goes to the framebuffer object, so no surface is needed
+  if (m_context == EGL_NO_CONTEXT || !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+    eglTerminate(m_display);
+    throw std::runtime_error("OffscreenContext: cannot create a surfaceless OpenGL 3.3 context");
+  }
+#else
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  m_window = glfwCreateWindow(width, height, "ParticleViewer", nullptr, nullptr);
+  if (!m_window) {
+    glfwTerminate();
+    throw std::runtime_error("OffscreenContext: cannot create a hidden GLFW window");
+  }
+  glfwMakeContextCurrent(m_window);
+#endif
+
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  // GLEW built for GLX reports the missing X display, the core functions are loaded regardless
+  if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+    err = GLEW_OK;
+#endif
+  if (err != GLEW_OK)
+    throw std::runtime_error("OffscreenContext: cannot initialise GLEW");
+
+  glGenFramebuffers(1, &m_fbo);
+  glGenRenderbuffers(1, &m_colour);
+  glGenRenderbuffers(1, &m_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_colour);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colour);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw std::runtime_error("OffscreenContext: incomplete framebuffer");
+
+  glViewport(0, 0, width, height);
+}
+
+OffscreenContext::~OffscreenContext() {
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteRenderbuffers(1, &m_depth);
+  glDeleteRenderbuffers(1, &m_colour);
+  glDeleteFramebuffers(1, &m_fbo);
+
+#ifdef PARTICLEVIEWER_EGL
+  eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(m_display, m_context);
+  eglTerminate(m_display);
+#else
+  glfwDestroyWindow(m_window);
+  glfwTerminate();
+#endif
+}
+
+void OffscreenContext::readPixels(Image& image) const {
+  image.resize(m_width, m_height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, &image.data()[0]);
+  image.flipVertical();
+}
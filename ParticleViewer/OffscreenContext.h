@@ -0,0 +1,48 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#ifdef PARTICLEVIEWER_EGL
+#include <EGL/egl.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+#include "Image.h"
+
+// OpenGL 3.3 core context without a visible window, rendering into a
+// framebuffer object of a fixed size. Used for batch rendering on machines
+// without a display.
+//
+// Built with PARTICLEVIEWER_EGL defined (and linked against libEGL), the
+// context comes from an EGL surfaceless display, which needs neither X11 nor
+// a GPU: Mesa's llvmpipe renders on the CPU. Otherwise a hidden GLFW window
+// provides the context, which still needs a display server.
+class OffscreenContext {
+public:
+  // Creates the context, loads the GL functions and binds the framebuffer;
+  // throws std::runtime_error on failure
+  OffscreenContext(int width, int height);
+  ~OffscreenContext();
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+
+  // Wait for rendering to finish and copy the framebuffer into image
+  void readPixels(Image& image) const;
+
+private:
+  OffscreenContext(const OffscreenContext&) = delete;
+  OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+  int m_width, m_height;
+
+#ifdef PARTICLEVIEWER_EGL
+  EGLDisplay m_display{EGL_NO_DISPLAY};
+  EGLContext m_context{EGL_NO_CONTEXT};
+#else
+  GLFWwindow* m_window{nullptr};
+#endif
+
+  GLuint m_fbo{0}, m_colour{0}, m_depth{0};
+};
@@ -3,6 +3,7 @@
 
 
 Particle::Particle(glm::vec3 position)
+	: velocity(0.0f), id(0), gasDensity(0.0f), gasTemperature(0.0f), gasVelocity(0.0f)
 {
 	this->position = position;
 }
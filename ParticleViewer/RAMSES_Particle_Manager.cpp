@@ -3,134 +3,197 @@
 // RAMSES
 #include "ramses/RAMSES_info.hh"
 #include "ramses/RAMSES_particle_data.hh"
+#include "ramses/RAMSES_parallel.hh"
+#include "ramses/RAMSES_amr_data.hh"
+#include "ramses/RAMSES_hydro_data.hh"
+#include "ramses/RAMSES_derived_fields.hh"
+#include "ramses/RAMSES_particle_index.hh"
 
-#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
 
-RAMSES_Particle_Manager::RAMSES_Particle_Manager(std::string filename)
+// Whether the hydro_XXXXX.outNNNNN file of a domain exists next to the info file
+static bool hasHydroFile(const RAMSES::snapshot& rsnap, unsigned idom)
+{
+	std::string path = rsnap.m_filename;
+	size_t ii = path.rfind("info_");
+	if (ii == std::string::npos)
+		return false;
+	char ext[32];
+	snprintf(ext, sizeof(ext), ".out%05u", idom + 1);
+	path = path.substr(0, ii) + "hydro_" + path.substr(ii + 5, 5) + ext;
+	return std::ifstream(path.c_str()).good();
+}
+
+// Attaches the gas properties of the enclosing leaf cell to the particles of one domain,
+// returns the number of particles that lie in leaf cells owned by the domain
+static size_t attachGas(RAMSES::snapshot& rsnap, unsigned idom, std::vector<Particle>& particles)
+{
+	typedef RAMSES::AMR::cell_locally_essential<> Cell;
+	typedef RAMSES::AMR::tree<Cell, RAMSES::AMR::level<Cell>> Tree;
+
+	if (particles.empty())
+		return 0;
+
+	// Hydro data needs maxlevel < levelmax
+	Tree tree(rsnap, idom + 1, rsnap.m_header.levelmax - 1, 1);
+	tree.read_cached(tree.default_cache_fname());
+
+	RAMSES::HYDRO::data<Tree, float> hydro(tree);
+	std::vector<std::string> vars = { "density", "pressure", "velocity_x", "velocity_y", "velocity_z" };
+	// Only the coarse level up front, sample_points reads the levels the particles sit on
+	hydro.read_levels(vars, 0, 0);
+
+	// Particle positions are in code units [0,boxlen], the tree in box units [0,1]
+	size_t n = particles.size();
+	float scale = (float)(1.0 / rsnap.m_header.boxlen);
+	std::vector<float> x(n), y(n), z(n), gas(vars.size() * n, 0.0f);
+	for (size_t i = 0; i < n; i++)
+	{
+		x[i] = particles[i].position.x * scale;
+		y[i] = particles[i].position.y * scale;
+		z[i] = particles[i].position.z * scale;
+	}
+	size_t found = RAMSES::HYDRO::sample_points(tree, hydro, &x[0], &y[0], &z[0], n, &gas[0]);
+
+	float tscale = (float)RAMSES::HYDRO::temperature_scale(rsnap);
+	for (size_t i = 0; i < n; i++)
+	{
+		const float* g = &gas[vars.size() * i];
+		if (g[0] <= 0.0f)
+			continue;
+		particles[i].gasDensity = g[0];
+		particles[i].gasTemperature = tscale * g[1] / g[0];
+		particles[i].gasVelocity = glm::vec3(g[2], g[3], g[4]);
+	}
+	return found;
+}
+
+// Mixes the bits of a particle ID, ordering by the result shuffles the particles
+// the same way in every snapshot
+static long long hashId(long long id)
+{
+	unsigned long long h = (unsigned long long)id + 0x9E3779B97F4A7C15ull;
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+	return (long long)(h ^ (h >> 31));
+}
+
+RAMSES_Particle_Manager::RAMSES_Particle_Manager(std::string filename, bool withGas, bool withMotion)
+	: hasGas(false)
 {
 	std::cout << "ParticleManager reading RAMSES dataset." << std::endl;
 	// Load the RAMSES particle data into vector<particle> arrays
 	RAMSES::snapshot rsnap(filename, RAMSES::version3);
 	std::cout << "aexp = " << rsnap.m_header.aexp << std::endl;
-	// Reserve memory in particle vector
-	int npart = (int)std::pow((double)rsnap.m_header.levelmax, 3.0f);
-	bool dmonly = false;
-	bool ompEnabled = false;
+	this->time = rsnap.m_header.time;
+	this->boxlen = rsnap.m_header.boxlen;
 
 	std::vector<Particle> vec;
-	std::vector<std::vector<Particle>> buffers;
+	std::vector<std::vector<Particle>> buffers(rsnap.m_header.ncpu);
+	std::vector<size_t> gasFound(rsnap.m_header.ncpu, 0);
+	std::vector<char> gasMissing(rsnap.m_header.ncpu, 0);
+	std::vector<std::string> gasErrors(rsnap.m_header.ncpu);
+
+	std::cout << "Reading " << rsnap.m_header.ncpu << " domains." << std::endl;
 
-	if (ompEnabled)
+	// Each domain is read into its own buffer, at most RAMSES_MAX_OPEN_FILES at a time
+	RAMSES::for_each_domain(rsnap.m_header.ncpu, [&](unsigned idom)
 	{
-#pragma omp parallel
+		RAMSES::PART::data data(rsnap, idom + 1);
+		std::vector<float> x, y, z, age, vx, vy, vz;
+		std::vector<long long> ids;
+		data.get_var<double>("position_x", std::back_inserter(x));
+
+		y.reserve(x.size());
+		z.reserve(x.size());
+		age.reserve(x.size());
+
+		data.get_var<double>("position_y", std::back_inserter(y));
+		data.get_var<double>("position_z", std::back_inserter(z));
+		data.get_ids(std::back_inserter(ids));
+		if (withMotion)
 		{
-			auto nthreads = omp_get_num_threads();
-			auto id = omp_get_thread_num();
-			// Correctly set number of buffers
-#pragma omp single
-			{
-				std::cout << "OMP enabled with " << nthreads << " threads." << std::endl;
-				buffers.resize(nthreads);
-			}
-			// Each thread pushes to own buffer
-	//#pragma omp for schedule(static)
-#pragma omp parallel for
-			for (int icpu = 1; icpu <= rsnap.m_header.ncpu; icpu++)
-			{
-				RAMSES::PART::data local_data(rsnap, icpu);
-				std::vector<float> x, y, z, age;
-				local_data.get_var<double>("position_x", std::back_inserter(x));
-
-				y.reserve(x.size());
-				z.reserve(x.size());
-				age.reserve(x.size());
-
-				local_data.get_var<double>("position_y", std::back_inserter(y));
-				local_data.get_var<double>("position_z", std::back_inserter(z));
-
-				try
-				{
-					local_data.get_var<double>("age", std::back_inserter(age));
-				}
-				catch (...) {
-					dmonly = true;
-				}
-				delete &local_data;
-
-				for (size_t i = 0; i < x.size(); i++)
-				{
-					if (dmonly)
-					{
-						glm::vec3 pos(x[i], y[i], z[i]);
-						Particle newParticle(pos);
-						buffers[id].push_back(newParticle);
-					}
-					else
-					{
-						if (age[i] == 0)
-						{
-							glm::vec3 pos(x[i], y[i], z[i]);
-							Particle newParticle(pos);
-							buffers[id].push_back(newParticle);
-						}
-					}
-				}
-			}
+			data.get_var<double>("velocity_x", std::back_inserter(vx));
+			data.get_var<double>("velocity_y", std::back_inserter(vy));
+			data.get_var<double>("velocity_z", std::back_inserter(vz));
+		}
+
+		bool dmonly = false;
+		try
+		{
+			data.get_var<double>("age", std::back_inserter(age));
+		}
+		catch (...) {
+			dmonly = true;
+		}
 
-			// Combine the buffers
-#pragma omp single
-			for (auto & buffer : buffers)
+		std::vector<Particle>& buffer = buffers[idom];
+		for (size_t i = 0; i < x.size(); i++)
+		{
+			if (dmonly || age[i] == 0)
 			{
-				std::move(buffer.begin(), buffer.end(), std::back_inserter(vec));
+				glm::vec3 pos(x[i], y[i], z[i]);
+				Particle newParticle(pos);
+				newParticle.id = ids[i];
+				if (withMotion)
+					newParticle.velocity = glm::vec3(vx[i], vy[i], vz[i]);
+				buffer.push_back(newParticle);
 			}
 		}
-	}
-	else {
-		for (int icpu = 1; icpu <= rsnap.m_header.ncpu; icpu++)
-		{
-			std::cout << "Reading icpu " << icpu << "/" << rsnap.m_header.ncpu << std::endl;
-			RAMSES::PART::data data(rsnap, icpu);
-			std::vector<float> x, y, z, age;
-			data.get_var<double>("position_x", std::back_inserter(x));
-
-			y.reserve(x.size());
-			z.reserve(x.size());
-			age.reserve(x.size());
-
-			data.get_var<double>("position_y", std::back_inserter(y));
-			data.get_var<double>("position_z", std::back_inserter(z));
 
+		// Particles are stored with the domain owning their cell, sample the gas there
+		// Only a missing hydro file means "no gas", other errors are reported
+		if (withGas && !hasHydroFile(rsnap, idom))
+			gasMissing[idom] = 1;
+		else if (withGas)
+		{
 			try
 			{
-				data.get_var<double>("age", std::back_inserter(age));
+				gasFound[idom] = attachGas(rsnap, idom, buffer);
 			}
-			catch (...) {
-				dmonly = true;
-			}
-
-			for (size_t i = 0; i < x.size(); i++)
+			catch (std::exception& e)
 			{
-				if (dmonly)
-				{
-					glm::vec3 pos(x[i], y[i], z[i]);
-					Particle newParticle(pos);
-					vec.push_back(newParticle);
-				}
-				else
-				{
-					if (age[i] == 0)
-					{
-						glm::vec3 pos(x[i], y[i], z[i]);
-						Particle newParticle(pos);
-						vec.push_back(newParticle);
-					}
-				}
+				gasErrors[idom] = e.what();
 			}
 		}
+	});
+
+	if (withGas)
+	{
+		size_t found = 0, missing = 0;
+		for (unsigned idom = 0; idom < rsnap.m_header.ncpu; idom++)
+		{
+			found += gasFound[idom];
+			missing += gasMissing[idom];
+			if (!gasErrors[idom].empty())
+				std::cerr << "Cannot sample the gas of domain " << idom + 1 << ": " << gasErrors[idom] << std::endl;
+		}
+		this->hasGas = found > 0;
+		std::cout << "Attached gas properties to " << found << " particles";
+		if (missing > 0)
+			std::cout << " (no hydro data for " << missing << " domains)";
+		std::cout << "." << std::endl;
+	}
+
+	// Combine the buffers in domain order
+	for (auto & buffer : buffers)
+	{
+		std::move(buffer.begin(), buffer.end(), std::back_inserter(vec));
 	}
 
-	std::random_shuffle(vec.begin(), vec.end());
-    this->mParticleArray = vec;
+	// Shuffle by hashed ID so that the drawn subset is the same in every snapshot
+	std::vector<long long> keys(vec.size());
+	for (size_t i = 0; i < vec.size(); i++)
+		keys[i] = hashId(vec[i].id);
+	std::vector<size_t> order;
+	RAMSES::PART::radix_sort_ids(keys, order);
+	this->mParticleArray.reserve(vec.size());
+	for (size_t i = 0; i < order.size(); i++)
+		this->mParticleArray.push_back(vec[order[i]]);
     this->npart = static_cast<int>(this->mParticleArray.size());
 
     // Cap the number of particles to draw for performance (density splatting accumulates a lot)
@@ -158,6 +221,36 @@ GLfloat * RAMSES_Particle_Manager::particlesArray()
 }
 
 
+GLfloat * RAMSES_Particle_Manager::gasArray()
+{
+	GLfloat *gArray = new float[this->npartDraw];
+
+	// Log density range over the drawn particles that carry gas properties
+	float lmin = std::numeric_limits<float>::max(), lmax = -std::numeric_limits<float>::max();
+	for (int i = 0; i < this->npartDraw; i++)
+	{
+		float rho = this->mParticleArray[i].gasDensity;
+		gArray[i] = rho > 0.0f ? std::log10(rho) : -std::numeric_limits<float>::max();
+		if (rho > 0.0f)
+		{
+			lmin = std::min(lmin, gArray[i]);
+			lmax = std::max(lmax, gArray[i]);
+		}
+	}
+
+	float scale = lmax > lmin ? 1.0f / (lmax - lmin) : 0.0f;
+	for (int i = 0; i < this->npartDraw; i++)
+	{
+		if (this->mParticleArray[i].gasDensity > 0.0f)
+			gArray[i] = (gArray[i] - lmin) * scale;
+		else
+			gArray[i] = -1.0f;
+	}
+
+	return gArray;
+}
+
+
 RAMSES_Particle_Manager::~RAMSES_Particle_Manager()
 {
 }
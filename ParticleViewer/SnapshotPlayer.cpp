@@ -0,0 +1,286 @@
+#include "SnapshotPlayer.h"
+
+#include "RAMSES_Particle_Manager.h"
+#include "ramses/RAMSES_particle_index.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+SnapshotPlayer::SnapshotPlayer(const std::vector<std::string>& infoFiles, size_t start, bool withGas, bool withMotion)
+    : m_files(infoFiles), m_withGas(withGas), m_withMotion(withMotion) {
+  if (m_files.empty())
+    throw std::runtime_error("SnapshotPlayer: no snapshots to play");
+
+  glGenVertexArrays(2, m_vao);
+  glGenBuffers(2, m_vbo);
+  glGenBuffers(2, m_gasVbo);
+  glGenBuffers(2, m_motionVbo);
+
+  // The first snapshot is loaded synchronously, the next ones in the background
+  m_current = m_target = std::min(start, m_files.size() - 1);
+  swapIn(load(m_files[m_current], m_withGas, m_withMotion));
+  prefetch();
+}
+
+SnapshotPlayer::~SnapshotPlayer() {
+  // Outstanding loads finish before their futures are released
+  m_pending.clear();
+  m_retired.clear();
+  if (m_pendingMotion.valid())
+    m_pendingMotion.wait();
+
+  glDeleteBuffers(2, m_motionVbo);
+  glDeleteBuffers(2, m_gasVbo);
+  glDeleteBuffers(2, m_vbo);
+  glDeleteVertexArrays(2, m_vao);
+}
+
+std::shared_ptr<SnapshotPlayer::Frame> SnapshotPlayer::load(const std::string& infoFile, bool withGas, bool withMotion) {
+  RAMSES_Particle_Manager manager(infoFile, withGas, withMotion);
+
+  std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+  frame->time = manager.time;
+  frame->boxlen = manager.boxlen;
+  GLfloat* positions = manager.particlesArray();
+  frame->positions.assign(positions, positions + 3 * manager.npartDraw);
+  delete[] positions;
+
+  if (manager.hasGas) {
+    GLfloat* gas = manager.gasArray();
+    frame->gas.assign(gas, gas + manager.npartDraw);
+    delete[] gas;
+  }
+
+  if (withMotion) {
+    frame->ids.resize(manager.npartDraw);
+    frame->velocities.resize(3 * manager.npartDraw);
+    for (int i = 0; i < manager.npartDraw; i++) {
+      const Particle& p = manager.mParticleArray[i];
+      frame->ids[i] = p.id;
+      frame->velocities[3 * i] = p.velocity.x;
+      frame->velocities[3 * i + 1] = p.velocity.y;
+      frame->velocities[3 * i + 2] = p.velocity.z;
+    }
+  }
+  return frame;
+}
+
+std::shared_ptr<SnapshotPlayer::Motion> SnapshotPlayer::match(std::shared_ptr<Frame> from, PendingFrame pendingTo) {
+  std::shared_ptr<Frame> to = pendingTo.get();
+
+  // Unmatched particles stay in place
+  std::shared_ptr<Motion> motion = std::make_shared<Motion>();
+  motion->target = from->positions;
+  motion->tangent0.assign(from->positions.size(), 0.0f);
+  motion->tangent1.assign(from->positions.size(), 0.0f);
+
+  // RAMSES particles move by x += v dt in code units, so v dt is the Hermite tangent
+  double dt = to->time - from->time;
+  double box = from->boxlen;
+  RAMSES::PART::id_index fromIndex(from->ids), toIndex(to->ids);
+  RAMSES::PART::join(fromIndex, toIndex, [&](size_t a, size_t b) {
+    for (int d = 0; d < 3; d++) {
+      double x0 = from->positions[3 * a + d];
+      double dx = to->positions[3 * b + d] - x0;
+      // The shortest displacement in the periodic box
+      dx -= box * std::floor(dx / box + 0.5);
+      motion->target[3 * a + d] = (GLfloat)(x0 + dx);
+      motion->tangent0[3 * a + d] = (GLfloat)(from->velocities[3 * a + d] * dt);
+      motion->tangent1[3 * a + d] = (GLfloat)(to->velocities[3 * b + d] * dt);
+    }
+  });
+  return motion;
+}
+
+void SnapshotPlayer::prefetch() {
+  // Window: the requested snapshot and the next kPrefetchDepth in the playback direction
+  std::map<size_t, PendingFrame> window;
+  long long first = (long long)m_target;
+  for (long long k = 0; k <= (long long)kPrefetchDepth; ++k) {
+    long long index = first + k * m_direction;
+    if (index < 0 || index >= (long long)m_files.size() || (size_t)index == m_current)
+      continue;
+
+    std::map<size_t, PendingFrame>::iterator it = m_pending.find((size_t)index);
+    if (it != m_pending.end()) {
+      window[(size_t)index] = it->second;
+      m_pending.erase(it);
+    } else {
+      window[(size_t)index] = std::async(std::launch::async, &SnapshotPlayer::load,
+                                         m_files[(size_t)index], m_withGas, m_withMotion).share();
+    }
+  }
+
+  // Releasing a running load would block, so it is kept until it finishes
+  for (std::map<size_t, PendingFrame>::iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+    m_retired.push_back(it->second);
+  m_pending.swap(window);
+
+  for (size_t i = 0; i < m_retired.size();) {
+    if (m_retired[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      m_retired[i] = m_retired.back();
+      m_retired.pop_back();
+    } else {
+      ++i;
+    }
+  }
+}
+
+void SnapshotPlayer::swapIn(const std::shared_ptr<Frame>& pframe) {
+  const Frame& frame = *pframe;
+  int back = 1 - m_front;
+  m_count[back] = (GLsizei)(frame.positions.size() / 3);
+  m_hasGas[back] = !frame.gas.empty();
+  m_hasMotion[back] = false;
+
+  glBindVertexArray(m_vao[back]);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo[back]);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * frame.positions.size(),
+               frame.positions.empty() ? nullptr : &frame.positions[0], GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+  glEnableVertexAttribArray(0);
+
+  if (m_hasGas[back]) {
+    glBindBuffer(GL_ARRAY_BUFFER, m_gasVbo[back]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * frame.gas.size(), &frame.gas[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(1);
+  } else {
+    glDisableVertexAttribArray(1);
+  }
+  for (GLuint attrib = 2; attrib <= 4; attrib++)
+    glDisableVertexAttribArray(attrib);
+
+  glBindVertexArray(0);
+  m_front = back;
+  // The new frame has no motion yet, draw it at its snapshot positions
+  m_motionT = 0.0f;
+  m_boxlen = (GLfloat)frame.boxlen;
+  if (m_withMotion)
+    m_shown = pframe;
+}
+
+void SnapshotPlayer::updateMotion(double time) {
+  if (m_pendingMotion.valid()) {
+    if (m_pendingMotion.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return;
+    std::shared_ptr<Motion> motion;
+    try {
+      motion = m_pendingMotion.get();
+    } catch (std::exception& e) {
+      std::cerr << "SnapshotPlayer: cannot match " << m_files[m_motionFrom] << " with the next snapshot: " << e.what() << std::endl;
+      m_interpolate = false;
+      return;
+    }
+    // Stale if the shown snapshot changed in the meantime
+    if (m_motionFrom != m_current || m_hasMotion[m_front])
+      return;
+
+    // Target, tangent0 and tangent1 streams back to back in one buffer
+    size_t bytes = sizeof(GLfloat) * motion->target.size();
+    glBindVertexArray(m_vao[m_front]);
+    glBindBuffer(GL_ARRAY_BUFFER, m_motionVbo[m_front]);
+    glBufferData(GL_ARRAY_BUFFER, 3 * bytes, nullptr, GL_STATIC_DRAW);
+    if (bytes > 0) {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &motion->target[0]);
+      glBufferSubData(GL_ARRAY_BUFFER, bytes, bytes, &motion->tangent0[0]);
+      glBufferSubData(GL_ARRAY_BUFFER, 2 * bytes, bytes, &motion->tangent1[0]);
+    }
+    for (GLuint attrib = 2; attrib <= 4; attrib++) {
+      glVertexAttribPointer(attrib, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)((attrib - 2) * bytes));
+      glEnableVertexAttribArray(attrib);
+    }
+    glBindVertexArray(0);
+    m_hasMotion[m_front] = true;
+    m_motionStart = time;
+    m_motionT = 0.0f;
+    return;
+  }
+
+  // Start matching once the next snapshot is in memory
+  if (!isInterpolating() || m_direction < 0 || m_hasMotion[m_front] || !m_shown || m_current + 1 >= m_files.size())
+    return;
+  std::map<size_t, PendingFrame>::iterator it = m_pending.find(m_current + 1);
+  if (it == m_pending.end() || it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return;
+  m_motionFrom = m_current;
+  m_pendingMotion = std::async(std::launch::async, &SnapshotPlayer::match, m_shown, it->second);
+}
+
+void SnapshotPlayer::update(double time) {
+  updateMotion(time);
+
+  // Position along the Hermite curve towards the next snapshot, frozen while paused
+  if (!motionActive())
+    m_motionT = 0.0f;
+  else if (m_playing)
+    m_motionT = (float)std::min(1.0, std::max(0.0, (time - m_motionStart) / m_motionDuration));
+  else
+    m_motionStart = time - m_motionT * m_motionDuration;
+
+  // While interpolating, the next snapshot is due when the particles have reached it
+  bool due = isInterpolating() && m_direction > 0 && m_current + 1 < m_files.size()
+                 ? m_hasMotion[m_front] && m_motionT >= 1.0f
+                 : time - m_lastSwap >= m_interval;
+  if (m_playing && m_target == m_current && due) {
+    long long next = (long long)m_current + m_direction;
+    if (next < 0 || next >= (long long)m_files.size())
+      m_playing = false;
+    else
+      m_target = (size_t)next;
+  }
+
+  prefetch();
+
+  if (m_target != m_current) {
+    std::map<size_t, PendingFrame>::iterator it = m_pending.find(m_target);
+    if (it != m_pending.end() && it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      PendingFrame pending = it->second;
+      m_pending.erase(it);
+      try {
+        swapIn(pending.get());
+        m_current = m_target;
+        m_lastSwap = time;
+        std::cout << "Showing " << m_files[m_current] << std::endl;
+      } catch (std::exception& e) {
+        std::cerr << "SnapshotPlayer: cannot load " << m_files[m_target] << ": " << e.what() << std::endl;
+        m_target = m_current;
+        m_playing = false;
+      }
+      prefetch();
+    }
+  }
+}
+
+void SnapshotPlayer::draw(GLuint program) const {
+  // uMotionT = 0 draws the particles at their snapshot positions
+  glUniform1f(glGetUniformLocation(program, "uMotionT"), m_motionT);
+  glUniform1f(glGetUniformLocation(program, "uBoxLen"), m_boxlen);
+
+  glBindVertexArray(m_vao[m_front]);
+  // Without gas data the attribute is constant, -1 marks "no gas" in the shader
+  if (!m_hasGas[m_front])
+    glVertexAttrib1f(1, -1.0f);
+  glDrawArrays(GL_POINTS, 0, m_count[m_front]);
+  glBindVertexArray(0);
+}
+
+void SnapshotPlayer::step(int delta) {
+  long long target = (long long)m_target + delta;
+  target = std::max(0LL, std::min(target, (long long)m_files.size() - 1));
+  if (delta != 0)
+    m_direction = delta > 0 ? 1 : -1;
+  m_target = (size_t)target;
+}
+
+void SnapshotPlayer::togglePlay() {
+  m_playing = !m_playing;
+  // Playing from the last snapshot restarts at the first one
+  if (m_playing && m_direction > 0 && m_current + 1 >= m_files.size() && m_target == m_current) {
+    m_target = 0;
+  }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <map>
+#include <future>
+
+#include <GL/glew.h>
+
+// Time-series playback over consecutive snapshots of a run. A bounded
+// background prefetcher loads the next snapshots in the playback direction
+// (positions decoded, subsampled and packed for upload) while the current
+// one is displayed, so stepping only waits when loading is slower than the
+// playback rate.
+//
+// Particle data lives in two sets of GPU buffers. A new snapshot is uploaded
+// into the set that is not being drawn and the sets are swapped afterwards,
+// so the buffers of the frame in flight are never overwritten.
+//
+// With motion enabled, the particles of the shown snapshot are matched by ID
+// with the next one once it is prefetched, and move smoothly towards it while
+// playing forward: particle.vs interpolates between the two positions with a
+// cubic Hermite curve whose tangents are the particle velocities.
+class SnapshotPlayer {
+public:
+  // infoFiles are the info_XXXXX.txt files in playback order; the snapshot at
+  // start is loaded before the constructor returns. withMotion also reads the
+  // particle velocities, which interpolated playback needs
+  SnapshotPlayer(const std::vector<std::string>& infoFiles, size_t start, bool withGas, bool withMotion = false);
+  ~SnapshotPlayer();
+
+  // Once per frame: swaps in a prefetched snapshot when one is due and keeps
+  // the prefetch window filled; time is the current time in seconds
+  void update(double time);
+
+  // Draw the particles of the current snapshot with the bound shader program,
+  // setting its motion uniforms
+  void draw(GLuint program) const;
+
+  // Request the snapshot delta steps away from the last requested one
+  void step(int delta);
+  void togglePlay();
+  bool isPlaying() const { return m_playing; }
+
+  // Minimum time a snapshot stays on screen while playing
+  void setInterval(double seconds) { m_interval = seconds; }
+
+  // Interpolated playback, only while playing forward
+  void toggleInterpolation() { m_interpolate = !m_interpolate; }
+  bool isInterpolating() const { return m_withMotion && m_interpolate; }
+  // Time taken to move from one snapshot to the next
+  void setMotionDuration(double seconds) { m_motionDuration = seconds; }
+
+  // True while a requested snapshot is not shown yet
+  bool isLoading() const { return m_target != m_current; }
+
+  size_t current() const { return m_current; }
+  // Whether the gas properties of the particles are loaded
+  bool withGas() const { return m_withGas; }
+  size_t size() const { return m_files.size(); }
+  const std::string& currentFile() const { return m_files[m_current]; }
+
+private:
+  // A snapshot prepared for upload
+  struct Frame {
+    std::vector<GLfloat> positions;   // 3 floats per drawn particle
+    std::vector<GLfloat> gas;         // scaled log gas density per drawn particle, empty without gas
+    std::vector<long long> ids;       // per drawn particle, empty without motion
+    std::vector<GLfloat> velocities;  // 3 floats per drawn particle, empty without motion
+    double time{0.0};
+    double boxlen{1.0};
+  };
+  typedef std::shared_future<std::shared_ptr<Frame>> PendingFrame;
+
+  // Hermite control data moving the particles of one frame to the next, 3
+  // floats per particle of the first frame
+  struct Motion {
+    std::vector<GLfloat> target;    // matched position, unwrapped across the periodic box
+    std::vector<GLfloat> tangent0;  // velocity times the time between the frames
+    std::vector<GLfloat> tangent1;
+  };
+
+  // Run on worker threads
+  static std::shared_ptr<Frame> load(const std::string& infoFile, bool withGas, bool withMotion);
+  static std::shared_ptr<Motion> match(std::shared_ptr<Frame> from, PendingFrame to);
+
+  // Start loads for the snapshots ahead in the playback direction and retire
+  // the ones that left the window
+  void prefetch();
+
+  // Upload into the back buffer set and make it the front one
+  void swapIn(const std::shared_ptr<Frame>& frame);
+
+  // Match the shown frame with the next one in the background and upload
+  // the result into the front buffer set once it is ready
+  void updateMotion(double time);
+  bool motionActive() const { return isInterpolating() && m_direction > 0 && m_hasMotion[m_front]; }
+
+  static const size_t kPrefetchDepth = 2;
+
+  std::vector<std::string> m_files;
+  bool m_withGas;
+  bool m_withMotion;
+
+  size_t m_current{0};
+  size_t m_target{0};
+  int m_direction{1};
+  bool m_playing{false};
+  double m_interval{0.1};
+  double m_lastSwap{0.0};
+  bool m_interpolate{true};
+  double m_motionDuration{1.0};
+  double m_motionStart{0.0};
+  float m_motionT{0.0f};
+
+  std::map<size_t, PendingFrame> m_pending;  // prefetch window by snapshot index
+  std::vector<PendingFrame> m_retired;       // loads that left the window, kept until they finish
+
+  std::shared_ptr<Frame> m_shown;            // the current frame, kept for matching with motion
+  std::future<std::shared_ptr<Motion>> m_pendingMotion;
+  size_t m_motionFrom{0};                    // snapshot index the pending motion starts from
+
+  // Double-buffered GL resources, m_front is the set being drawn
+  GLuint m_vao[2]{0, 0}, m_vbo[2]{0, 0}, m_gasVbo[2]{0, 0}, m_motionVbo[2]{0, 0};
+  GLsizei m_count[2]{0, 0};
+  bool m_hasGas[2]{false, false};
+  bool m_hasMotion[2]{false, false};
+  float m_boxlen{1.0f};
+  int m_front{0};
+};
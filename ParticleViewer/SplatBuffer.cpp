@@ -0,0 +1,78 @@
+#include "SplatBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const float SplatBuffer::kMinScale = 0.25f;
+
+SplatBuffer::SplatBuffer() {
+  m_shader.reset(new Shader("./resources/shaders/upsample.vs", "./resources/shaders/upsample.frag"));
+  glGenFramebuffers(1, &m_fbo);
+  glGenTextures(1, &m_texture);
+  glGenVertexArrays(1, &m_vao);
+}
+
+SplatBuffer::~SplatBuffer() {
+  glDeleteVertexArrays(1, &m_vao);
+  glDeleteTextures(1, &m_texture);
+  glDeleteFramebuffers(1, &m_fbo);
+}
+
+void SplatBuffer::setScale(float scale) {
+  m_scale = std::min(1.0f, std::max(kMinScale, scale));
+}
+
+void SplatBuffer::begin(int width, int height, int& renderWidth, int& renderHeight) {
+  renderWidth = width;
+  renderHeight = height;
+  if (!active())
+    return;
+
+  renderWidth = std::max(1, (int)(width * m_scale + 0.5f));
+  renderHeight = std::max(1, (int)(height * m_scale + 0.5f));
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_outFbo);
+  glGetIntegerv(GL_VIEWPORT, m_outViewport);
+
+  // Reallocate when the scale or the output size changes
+  if (renderWidth != m_width || renderHeight != m_height) {
+    m_width = renderWidth;
+    m_height = renderHeight;
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, m_width, m_height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    // Bilinear fetches are part of the bicubic filter
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      throw std::runtime_error("SplatBuffer: incomplete framebuffer");
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, m_width, m_height);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  m_bound = true;
+}
+
+void SplatBuffer::end() {
+  if (!m_bound)
+    return;
+  m_bound = false;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)m_outFbo);
+  glViewport(m_outViewport[0], m_outViewport[1], m_outViewport[2], m_outViewport[3]);
+
+  m_shader->Use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glUniform1i(glGetUniformLocation(m_shader->Program, "uSplats"), 0);
+  glBindVertexArray(m_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <memory>
+
+#include "include/Shader.h"
+
+// Off-screen target for the additive particle splats at a fraction of the
+// output resolution. Splatting is bound by fill rate, and the Gaussian
+// splats are smooth, so at half resolution a quarter of the fragments give a
+// near-identical image once upsampled. The splats accumulate in a half-float
+// texture, which end() upsamples with a bicubic B-spline filter (upsample.vs,
+// upsample.frag) and adds to the output framebuffer.
+//
+// At scale 1 begin() and end() do nothing and the splats go straight to the
+// output, as before.
+class SplatBuffer {
+public:
+  // Loads the upsampling shader; needs a current OpenGL context
+  SplatBuffer();
+  ~SplatBuffer();
+
+  // Fraction of the output resolution, clamped to [kMinScale, 1]
+  void setScale(float scale);
+  float scale() const { return m_scale; }
+  bool active() const { return m_scale < 1.0f; }
+
+  static const float kMinScale;
+
+  // Redirects rendering into the accumulation texture, cleared to black, for
+  // an output of width x height; renderWidth/renderHeight receive the size to
+  // render at (the output size when inactive)
+  void begin(int width, int height, int& renderWidth, int& renderHeight);
+  // Adds the upsampled splats to the framebuffer and viewport that were bound
+  // at begin(), with the current (additive) blending
+  void end();
+
+private:
+  SplatBuffer(const SplatBuffer&) = delete;
+  SplatBuffer& operator=(const SplatBuffer&) = delete;
+
+  float m_scale{1.0f};
+  bool m_bound{false};
+
+  std::unique_ptr<Shader> m_shader;
+  // m_vao is empty, the full-screen triangle comes from gl_VertexID
+  GLuint m_fbo{0}, m_texture{0}, m_vao{0};
+  int m_width{0}, m_height{0};
+
+  // Output framebuffer and viewport to return to in end()
+  GLint m_outFbo{0};
+  GLint m_outViewport[4]{0, 0, 0, 0};
+};
@@ -0,0 +1,242 @@
+#include "SplatRenderer.h"
+
+#include "RAMSES_Particle_Manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+const int kTileSize = 32;
+// Pixels covered by the largest (64 px) point along one axis
+const int kMaxSpan = 66;
+
+// A projected particle: centre in image pixels (rows top-down), half the point
+// size and its colour before the Gaussian weight; half = 0 marks clipped ones
+struct Splat {
+  float x, y, half;
+  float r, g, b;
+};
+
+// Tint of particle.frag
+inline glm::vec3 splatTint(float gas, bool colourByGas) {
+  if (colourByGas && gas >= 0.0f)
+    return glm::vec3(std::min(1.0f, 3.0f * gas),
+                     std::min(1.0f, std::max(0.0f, 3.0f * gas - 1.0f)),
+                     std::min(1.0f, std::max(0.0f, 3.0f * gas - 2.0f)) * 0.8f + 0.2f * gas);
+  return glm::vec3(0.85f, 0.9f, 1.0f);
+}
+
+// Pixels whose centres lie in [c - half, c + half), the GL point rasterisation rule
+inline void coveredRange(float c, float half, int limit, int& first, int& last) {
+  first = std::max(0, (int)std::ceil(c - half - 0.5f));
+  last = std::min(limit - 1, (int)std::ceil(c + half - 0.5f) - 1);
+}
+
+int numThreads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+}  // namespace
+
+SplatRenderer::SplatRenderer(const std::string& infoFilePath, bool withGas) {
+  RAMSES_Particle_Manager manager(infoFilePath, withGas);
+  GLfloat* positions = manager.particlesArray();
+  std::vector<float> gas;
+  if (manager.hasGas) {
+    GLfloat* g = manager.gasArray();
+    gas.assign(g, g + manager.npartDraw);
+    delete[] g;
+  }
+  setParticles(std::vector<float>(positions, positions + 3 * manager.npartDraw), gas);
+  delete[] positions;
+}
+
+void SplatRenderer::setParticles(std::vector<float> positions, std::vector<float> gas) {
+  m_positions.swap(positions);
+  m_gas.swap(gas);
+  if (m_gas.size() != size())
+    m_gas.clear();
+}
+
+void SplatRenderer::render(const glm::mat4& view, const glm::mat4& proj, const Params& params, Image& image) const {
+  const int width = image.width(), height = image.height();
+  const int tilesX = (width + kTileSize - 1) / kTileSize;
+  const int tilesY = (height + kTileSize - 1) / kTileSize;
+  const int numTiles = tilesX * tilesY;
+  const size_t n = size();
+  if (numTiles == 0)
+    return;
+
+  // Particles are processed in contiguous chunks, one per thread, so that the
+  // binning below keeps the draw order within every tile
+  const int nthreads = std::max(1, std::min(numThreads(), (int)(n / 4096) + 1));
+  std::vector<size_t> chunk(nthreads + 1);
+  for (int t = 0; t <= nthreads; ++t)
+    chunk[t] = n * t / nthreads;
+
+  // Vertex stage of particle.vs, model is the identity
+  std::vector<Splat> splats(n);
+  std::vector<size_t> count((size_t)nthreads * numTiles, 0);
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+  for (int t = 0; t < nthreads; ++t) {
+    size_t* tileCount = &count[(size_t)t * numTiles];
+    for (size_t i = chunk[t]; i < chunk[t + 1]; ++i) {
+      Splat& s = splats[i];
+      s.half = 0.0f;
+
+      glm::vec4 eye = view * glm::vec4(m_positions[3 * i], m_positions[3 * i + 1], m_positions[3 * i + 2], 1.0f);
+      glm::vec4 clip = proj * glm::vec4(eye.x, eye.y, eye.z, 1.0f);
+      // Points are clipped by their centre
+      if (!(std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w && std::fabs(clip.z) <= clip.w))
+        continue;
+
+      float dist = std::max(0.0001f, glm::length(glm::vec3(eye.x, eye.y, eye.z)));
+      float pointSize = std::min(64.0f, std::max(1.0f, params.pointBaseSize * (params.pointScale / dist)));
+      float intensity = std::min(1.0f, std::max(0.0f, 1.0f / (0.1f + 0.3f * dist)));
+      glm::vec3 colour = splatTint(m_gas.empty() ? -1.0f : m_gas[i], params.colourByGas) * (intensity * params.intensityScale);
+
+      s.x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+      s.y = (0.5f - clip.y / clip.w * 0.5f) * height;
+      s.half = 0.5f * pointSize;
+      s.r = colour.x;
+      s.g = colour.y;
+      s.b = colour.z;
+
+      int x0, x1, y0, y1;
+      coveredRange(s.x, s.half, width, x0, x1);
+      coveredRange(s.y, s.half, height, y0, y1);
+      if (x0 > x1 || y0 > y1) {
+        s.half = 0.0f;
+        continue;
+      }
+      for (int ty = y0 / kTileSize; ty <= y1 / kTileSize; ++ty)
+        for (int tx = x0 / kTileSize; tx <= x1 / kTileSize; ++tx)
+          ++tileCount[ty * tilesX + tx];
+    }
+  }
+
+  // Bin the splats by tile: offsets in (tile, thread) order, then each thread
+  // writes the references of its chunk
+  std::vector<size_t> tileStart(numTiles + 1, 0);
+  size_t offset = 0;
+  for (int tile = 0; tile < numTiles; ++tile) {
+    tileStart[tile] = offset;
+    for (int t = 0; t < nthreads; ++t) {
+      size_t c = count[(size_t)t * numTiles + tile];
+      count[(size_t)t * numTiles + tile] = offset;
+      offset += c;
+    }
+  }
+  tileStart[numTiles] = offset;
+
+  std::vector<uint32_t> refs(offset);
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+  for (int t = 0; t < nthreads; ++t) {
+    size_t* next = &count[(size_t)t * numTiles];
+    for (size_t i = chunk[t]; i < chunk[t + 1]; ++i) {
+      const Splat& s = splats[i];
+      if (s.half == 0.0f)
+        continue;
+      int x0, x1, y0, y1;
+      coveredRange(s.x, s.half, width, x0, x1);
+      coveredRange(s.y, s.half, height, y0, y1);
+      for (int ty = y0 / kTileSize; ty <= y1 / kTileSize; ++ty)
+        for (int tx = x0 / kTileSize; tx <= x1 / kTileSize; ++tx)
+          refs[next[ty * tilesX + tx]++] = (uint32_t)i;
+    }
+  }
+
+  // Fragment stage of particle.frag with additive blending, one tile per thread
+  const float sigma = params.sigma;
+  const int bgR = (int)(std::min(std::max(params.background.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+  const int bgG = (int)(std::min(std::max(params.background.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+  const int bgB = (int)(std::min(std::max(params.background.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int tile = 0; tile < numTiles; ++tile) {
+    const int tx0 = (tile % tilesX) * kTileSize, ty0 = (tile / tilesX) * kTileSize;
+    const int tx1 = std::min(width, tx0 + kTileSize), ty1 = std::min(height, ty0 + kTileSize);
+    const int stride = kTileSize;
+
+    // Accumulators: float colour, or 8-bit fragment values summed as integers
+    std::vector<float> accum(params.quantize ? 0 : 3 * kTileSize * kTileSize, 0.0f);
+    std::vector<int32_t> accumFixed(params.quantize ? 3 * kTileSize * kTileSize : 0, 0);
+    float dx2[kMaxSpan], ex[kMaxSpan];
+
+    for (size_t k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+      const Splat& s = splats[refs[k]];
+      int x0, x1, y0, y1;
+      coveredRange(s.x, s.half, width, x0, x1);
+      coveredRange(s.y, s.half, height, y0, y1);
+      x0 = std::max(x0, tx0);
+      x1 = std::min(x1, tx1 - 1);
+      y0 = std::max(y0, ty0);
+      y1 = std::min(y1, ty1 - 1);
+      const int span = x1 - x0 + 1;
+      if (span <= 0 || y0 > y1)
+        continue;
+
+      // gl_PointCoord * 2 - 1 is the pixel offset in units of half the point size
+      const float invHalf = 1.0f / s.half;
+      for (int j = 0; j < span; ++j) {
+        float d = (x0 + j + 0.5f - s.x) * invHalf;
+        dx2[j] = d * d;
+        ex[j] = std::exp(-dx2[j] * sigma);
+      }
+
+      for (int y = y0; y <= y1; ++y) {
+        float d = (y + 0.5f - s.y) * invHalf;
+        const float dy2 = d * d;
+        const float ey = std::exp(-dy2 * sigma);
+        const int row = (y - ty0) * stride + (x0 - tx0);
+
+        if (!params.quantize) {
+          float* r = &accum[row];
+          float* g = r + kTileSize * kTileSize;
+          float* b = g + kTileSize * kTileSize;
+          for (int j = 0; j < span; ++j) {
+            float w = dx2[j] + dy2 <= 1.0f ? ex[j] * ey : 0.0f;
+            r[j] += s.r * w;
+            g[j] += s.g * w;
+            b[j] += s.b * w;
+          }
+        } else {
+          int32_t* r = &accumFixed[row];
+          int32_t* g = r + kTileSize * kTileSize;
+          int32_t* b = g + kTileSize * kTileSize;
+          for (int j = 0; j < span; ++j) {
+            float w = dx2[j] + dy2 <= 1.0f ? ex[j] * ey * 255.0f : 0.0f;
+            r[j] += (int32_t)(s.r * w + 0.5f);
+            g[j] += (int32_t)(s.g * w + 0.5f);
+            b[j] += (int32_t)(s.b * w + 0.5f);
+          }
+        }
+      }
+    }
+
+    for (int y = ty0; y < ty1; ++y) {
+      for (int x = tx0; x < tx1; ++x) {
+        int i = (y - ty0) * stride + (x - tx0);
+        if (!params.quantize) {
+          image.setPixel(x, y, params.background.x + accum[i], params.background.y + accum[i + kTileSize * kTileSize],
+                         params.background.z + accum[i + 2 * kTileSize * kTileSize]);
+        } else {
+          uint8_t* p = image.pixel(x, y);
+          p[0] = (uint8_t)std::min(255, bgR + accumFixed[i]);
+          p[1] = (uint8_t)std::min(255, bgG + accumFixed[i + kTileSize * kTileSize]);
+          p[2] = (uint8_t)std::min(255, bgB + accumFixed[i + 2 * kTileSize * kTileSize]);
+        }
+      }
+    }
+  }
+}
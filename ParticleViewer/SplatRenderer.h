@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "Image.h"
+
+#include <glm/glm.hpp>
+
+// CPU renderer for the additive Gaussian particle splats of particle.vs and
+// particle.frag, computing the same point sizes, distance attenuation,
+// exp(-r2 * uSigma) weights and tints. It needs no GPU, and with quantize set
+// it also reproduces the 8-bit rounding of additive blending into an RGBA8
+// framebuffer, so it can serve as a reference for the GL output.
+//
+// Particles are transformed in parallel, then binned into screen tiles by a
+// counting sort. Every tile is rasterised by one thread into float (or
+// integer) accumulators. The Gaussian is separable, so each splat needs one
+// exp() per covered row and column. Its inner loop over a row is a branch-free
+// multiply-add that the compiler vectorises.
+class SplatRenderer {
+public:
+  // Same meaning as the uniforms of particle.vs and particle.frag
+  struct Params {
+    float pointBaseSize{6.0f};    // uPointBaseSize
+    float pointScale{1.0f};       // uPointScale
+    float sigma{4.0f};            // uSigma
+    float intensityScale{0.03f};  // uIntensityScale
+    bool colourByGas{false};      // uColourByGas
+    glm::vec3 background{0.02f, 0.02f, 0.03f};
+    // Round every fragment to 8 bits before adding it, as blending into an
+    // RGBA8 framebuffer does; otherwise accumulate in float
+    bool quantize{false};
+  };
+
+  SplatRenderer() {}
+  // Loads the same particle subset of a snapshot as the viewer draws; withGas
+  // also samples the gas density at the particles, for Params::colourByGas
+  explicit SplatRenderer(const std::string& infoFilePath, bool withGas = false);
+
+  // positions holds 3 floats per particle, gas the scaled log gas density per
+  // particle (-1 where there is none) or nothing
+  void setParticles(std::vector<float> positions, std::vector<float> gas);
+  size_t size() const { return m_positions.size() / 3; }
+
+  // Render the view into image (its size selects the resolution)
+  void render(const glm::mat4& view, const glm::mat4& proj, const Params& params, Image& image) const;
+
+private:
+  std::vector<float> m_positions;
+  std::vector<float> m_gas;
+};
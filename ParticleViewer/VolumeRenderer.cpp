@@ -0,0 +1,260 @@
+#include "VolumeRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "include/ramses/RAMSES_parallel.hh"
+
+namespace {
+
+const int kTileSize = 16;
+const glm::vec3 kBackground(0.02f, 0.02f, 0.03f);
+
+// Colour ramp for transfer values in (0,1]
+inline glm::vec3 rampColour(float t) {
+  return glm::vec3(std::min(1.0f, 3.0f * t),
+                   std::min(1.0f, std::max(0.0f, 3.0f * t - 1.0f)),
+                   std::min(1.0f, std::max(0.0f, 3.0f * t - 2.0f)) * 0.8f + 0.2f * t);
+}
+
+// Distances [tmin, tmax] along the ray inside the unit box, false if it misses
+bool clipToBox(const double origin[3], const double dir[3], double& tmin, double& tmax) {
+  tmin = 0.0;
+  tmax = std::numeric_limits<double>::max();
+  for (int a = 0; a < 3; ++a) {
+    if (dir[a] == 0.0) {
+      if (origin[a] < 0.0 || origin[a] > 1.0) return false;
+      continue;
+    }
+    double t0 = (0.0 - origin[a]) / dir[a], t1 = (1.0 - origin[a]) / dir[a];
+    tmin = std::max(tmin, std::min(t0, t1));
+    tmax = std::min(tmax, std::max(t0, t1));
+  }
+  return tmax > tmin;
+}
+
+} // namespace
+
+VolumeRenderer::VolumeRenderer(const std::string& infoFilePath) {
+  m_snap = std::make_unique<RAMSES::snapshot>(infoFilePath, RAMSES::version3);
+}
+
+void VolumeRenderer::build(const std::string& variable, unsigned maxLevel) {
+  // Hydro data needs maxlevel < levelmax
+  unsigned ilevelMax = std::min<unsigned>(maxLevel, m_snap->m_header.levelmax - 1);
+  std::vector<Domain> domains(m_snap->m_header.ncpu);
+
+  RAMSES::for_each_domain(m_snap->m_header.ncpu, [&](unsigned idom) {
+    Domain& domain = domains[idom];
+    std::unique_ptr<Tree> tree = std::make_unique<Tree>(*m_snap, idom + 1, ilevelMax, 1);
+    tree->read_cached(tree->default_cache_fname());
+
+    Hydro hydro(*tree);
+    hydro.read(variable);
+
+    domain.numLevels = std::min<int>(tree->m_maxlevel + 1, (int)tree->m_AMR_levels.size());
+    domain.log.assign(domain.numLevels, std::vector<float>());
+    for (int l = 0; l < domain.numLevels; ++l) {
+      const std::vector<Cell>& octs = tree->m_AMR_levels[l].m_level_cells;
+      std::vector<float>& logs = domain.log[l];
+      logs.assign(octs.size() * 8, std::numeric_limits<float>::quiet_NaN());
+      const std::vector<float>& values = hydro.slot_level(0, l);
+      for (size_t i = 0; i < octs.size(); ++i) {
+        if ((int)octs[i].m_cpu != tree->m_cpu) continue;
+        for (int k = 0; k < 8; ++k) {
+          bool leaf = l + 1 >= domain.numLevels || !octs[i].is_refined(k);
+          float v = 8 * i + k < values.size() ? values[8 * i + k] : 0.0f;
+          if (leaf && v > 0.0f) logs[8 * i + k] = std::log10(v);
+        }
+      }
+    }
+    domain.tree = std::move(tree);
+  });
+
+  m_domains.swap(domains);
+  m_numLevels = 0;
+  for (const Domain& domain : m_domains)
+    m_numLevels = std::max(m_numLevels, domain.numLevels);
+  setAutoRange();
+}
+
+void VolumeRenderer::setRange(float log10Min, float log10Max) {
+  m_logMin = log10Min;
+  m_logMax = std::max(log10Max, log10Min + 1e-6f);
+  updateTransfer();
+}
+
+void VolumeRenderer::setAutoRange() {
+  float lo = std::numeric_limits<float>::max(), hi = -lo;
+  for (const Domain& domain : m_domains)
+    for (const std::vector<float>& logs : domain.log)
+      for (float v : logs)
+        if (v == v) { lo = std::min(lo, v); hi = std::max(hi, v); }
+  if (lo > hi) { lo = 0.0f; hi = 1.0f; }
+  setRange(lo + 0.3f * (hi - lo), hi);
+}
+
+void VolumeRenderer::updateTransfer() {
+  float scale = 1.0f / (m_logMax - m_logMin);
+
+  for (Domain& domain : m_domains) {
+    const Tree& tree = *domain.tree;
+    domain.value.assign(domain.numLevels, std::vector<float>());
+    domain.subtreeMax.assign(domain.numLevels, std::vector<float>());
+
+    // Bottom-up so that children are final before their parents
+    for (int l = domain.numLevels - 1; l >= 0; --l) {
+      const std::vector<Cell>& octs = tree.m_AMR_levels[l].m_level_cells;
+      const std::vector<float>& logs = domain.log[l];
+      std::vector<float>& value = domain.value[l];
+      std::vector<float>& smax = domain.subtreeMax[l];
+      value.assign(logs.size(), 0.0f);
+      smax.assign(logs.size(), 0.0f);
+
+      for (size_t i = 0; i < octs.size(); ++i) {
+        for (int k = 0; k < 8; ++k) {
+          size_t key = 8 * i + k;
+          float v = logs[key] == logs[key] ? std::min(1.0f, (logs[key] - m_logMin) * scale) : 0.0f;
+          value[key] = std::max(v, 0.0f);
+          smax[key] = value[key];
+          if (l + 1 < domain.numLevels && octs[i].is_refined(k)) {
+            unsigned son = octs[i].m_son[k];
+            if (son < tree.m_AMR_levels[l + 1].m_level_cells.size()) {
+              const float* child = &domain.subtreeMax[l + 1][8 * size_t(son)];
+              smax[key] = *std::max_element(child, child + 8);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void VolumeRenderer::trace(const Domain& domain, const double origin[3], const double dir[3], double tmin, double tmax,
+                           std::vector<unsigned>& path, int& depth, std::vector<Segment>& segments) const {
+  const Tree& tree = *domain.tree;
+  const int numLevels = domain.numLevels;
+  if (numLevels == 0) return;
+
+  double invDir[3];
+  for (int a = 0; a < 3; ++a)
+    invDir[a] = dir[a] != 0.0 ? 1.0 / dir[a] : std::numeric_limits<double>::max();
+
+  const double nudge = std::ldexp(1.0, -(m_numLevels + 12));
+  double t = tmin;
+
+  while (t < tmax) {
+    double p[3] = { origin[0] + dir[0] * (t + nudge), origin[1] + dir[1] * (t + nudge), origin[2] + dir[2] * (t + nudge) };
+
+    // Climb until the cached oct contains the point
+    while (depth >= 0) {
+      const Cell& oct = tree.m_AMR_levels[depth].m_level_cells[path[depth]];
+      double h = std::ldexp(0.5, -depth);
+      if (std::fabs(p[0] - oct.m_xg[0]) <= h && std::fabs(p[1] - oct.m_xg[1]) <= h && std::fabs(p[2] - oct.m_xg[2]) <= h)
+        break;
+      --depth;
+    }
+    if (depth < 0) {
+      const std::vector<Cell>& coarse = tree.m_AMR_levels[0].m_level_cells;
+      for (unsigned i = 0; i < coarse.size() && depth < 0; ++i)
+        if (std::fabs(p[0] - coarse[i].m_xg[0]) <= 0.5 && std::fabs(p[1] - coarse[i].m_xg[1]) <= 0.5 && std::fabs(p[2] - coarse[i].m_xg[2]) <= 0.5) {
+          path[0] = i;
+          depth = 0;
+        }
+      if (depth < 0) break;
+    }
+
+    // Descend, stopping at leaves and at subtrees that are entirely transparent
+    unsigned ind;
+    bool empty;
+    while (true) {
+      const Cell& oct = tree.m_AMR_levels[depth].m_level_cells[path[depth]];
+      ind = (p[0] >= oct.m_xg[0]) + 2 * (p[1] >= oct.m_xg[1]) + 4 * (p[2] >= oct.m_xg[2]);
+      size_t key = 8 * size_t(path[depth]) + ind;
+      empty = domain.subtreeMax[depth][key] <= 0.0f;
+      if (empty || depth + 1 >= numLevels || !oct.is_refined(ind) ||
+          oct.m_son[ind] >= tree.m_AMR_levels[depth + 1].m_level_cells.size())
+        break;
+      path[++depth] = oct.m_son[ind];
+    }
+
+    // Exit distance from the cell
+    const Cell& oct = tree.m_AMR_levels[depth].m_level_cells[path[depth]];
+    double hc = std::ldexp(0.5, -(depth + 1));
+    double centre[3] = { oct.m_xg[0] + ((ind & 1) ? hc : -hc),
+                         oct.m_xg[1] + ((ind & 2) ? hc : -hc),
+                         oct.m_xg[2] + ((ind & 4) ? hc : -hc) };
+    double texit = tmax;
+    for (int a = 0; a < 3; ++a)
+      if (dir[a] != 0.0)
+        texit = std::min(texit, (centre[a] + (dir[a] > 0.0 ? hc : -hc) - origin[a]) * invDir[a]);
+    texit = std::max(texit, t + nudge);
+
+    if (!empty) {
+      float v = domain.value[depth][8 * size_t(path[depth]) + ind];
+      if (v > 0.0f) {
+        Segment segment = { t, texit, v };
+        segments.push_back(segment);
+      }
+    }
+    t = texit;
+  }
+}
+
+void VolumeRenderer::render(const glm::mat4& view, const glm::mat4& proj, Image& image) const {
+  if (m_domains.empty()) return;
+
+  const int width = image.width(), height = image.height();
+  glm::mat4 inv = glm::inverse(proj * view);
+  const int tilesX = (width + kTileSize - 1) / kTileSize;
+  const int tilesY = (height + kTileSize - 1) / kTileSize;
+  const int numTiles = tilesX * tilesY;
+
+  // Tiles are independent; within a tile, neighbouring rays start close
+  // together and reuse the cached tree paths of the previous ray
+#pragma omp parallel for schedule(dynamic)
+  for (int tile = 0; tile < numTiles; ++tile) {
+    std::vector<std::vector<unsigned>> paths(m_domains.size(), std::vector<unsigned>(m_numLevels));
+    std::vector<int> depths(m_domains.size(), -1);
+    std::vector<Segment> segments;
+    int x0 = (tile % tilesX) * kTileSize, y0 = (tile / tilesX) * kTileSize;
+    int x1 = std::min(width, x0 + kTileSize), y1 = std::min(height, y0 + kTileSize);
+
+    for (int y = y0; y < y1; ++y) {
+      for (int x = x0; x < x1; ++x) {
+        float ndcX = 2.0f * (x + 0.5f) / width - 1.0f;
+        float ndcY = 1.0f - 2.0f * (y + 0.5f) / height;
+        glm::vec4 nearPt = inv * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+        glm::vec4 farPt = inv * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+        double o[3] = { nearPt.x / nearPt.w, nearPt.y / nearPt.w, nearPt.z / nearPt.w };
+        double d[3] = { farPt.x / farPt.w - o[0], farPt.y / farPt.w - o[1], farPt.z / farPt.w - o[2] };
+        double len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        for (int a = 0; a < 3; ++a) d[a] /= len;
+
+        glm::vec3 c = kBackground;
+        double tmin, tmax;
+        if (clipToBox(o, d, tmin, tmax)) {
+          segments.clear();
+          for (size_t k = 0; k < m_domains.size(); ++k)
+            trace(m_domains[k], o, d, tmin, tmax, paths[k], depths[k], segments);
+          std::sort(segments.begin(), segments.end());
+
+          c = glm::vec3(0.0f);
+          float transmittance = 1.0f;
+          for (size_t k = 0; k < segments.size() && transmittance > 1.0f / 256.0f; ++k) {
+            float v = segments[k].value;
+            float alpha = 1.0f - std::exp(-m_opacity * v * v * float(segments[k].t1 - segments[k].t0));
+            c += transmittance * alpha * rampColour(v);
+            transmittance *= 1.0f - alpha;
+          }
+          c += transmittance * kBackground;
+        }
+        image.setPixel(x, y, c.x, c.y, c.z);
+      }
+    }
+  }
+}
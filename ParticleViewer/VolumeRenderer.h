@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "include/ramses/RAMSES_info.hh"
+#include "include/ramses/RAMSES_amr_data.hh"
+#include "include/ramses/RAMSES_hydro_data.hh"
+#include "Image.h"
+
+#include <glm/glm.hpp>
+
+// CPU volume renderer for a hydro variable on the AMR mesh of all domains.
+// Every pixel casts a ray that is integrated exactly cell by cell through the
+// leaf cells it crosses (emission-absorption, piecewise constant values), so
+// no fixed step size is needed and small cells are never skipped.
+//
+// Each domain has its own tree. The ray is traced through every tree, which
+// yields the segments through the leaf cells the domain owns; these partition
+// the box, so sorted along the ray they are composited front to back.
+//
+// The transfer function maps log10 of the variable onto [0,1]; cells below
+// the range are transparent. Each cell stores the maximum of this value over
+// its subtree, so rays step over whole empty subtrees without descending.
+// The image is split into tiles that are rendered by OpenMP threads.
+class VolumeRenderer {
+public:
+  typedef RAMSES::AMR::cell_locally_essential<> Cell;
+  typedef RAMSES::AMR::tree<Cell, RAMSES::AMR::level<Cell>> Tree;
+  typedef RAMSES::HYDRO::data<Tree, float> Hydro;
+
+  explicit VolumeRenderer(const std::string& infoFilePath);
+
+  // Load the AMR trees and one hydro variable of all domains on levels up to maxLevel
+  void build(const std::string& variable, unsigned maxLevel);
+  bool isBuilt() const { return !m_domains.empty(); }
+
+  // log10 range of the variable mapped onto the colour ramp
+  void setRange(float log10Min, float log10Max);
+  // Range from the owned leaf cells, the lowest part of it is left transparent
+  void setAutoRange();
+  float rangeMin() const { return m_logMin; }
+  float rangeMax() const { return m_logMax; }
+
+  // Absorption per unit box length at the top of the range
+  void setOpacity(float opacity) { m_opacity = opacity; }
+
+  // Render the view into image (its size selects the resolution)
+  void render(const glm::mat4& view, const glm::mat4& proj, Image& image) const;
+
+private:
+  struct Domain {
+    std::unique_ptr<Tree> tree;
+    int numLevels{0};
+    // Per level, 8 entries per oct: log10 of the variable in owned leaf cells
+    // (NaN elsewhere), the normalised transfer value of the cell and the
+    // maximum transfer value over its subtree
+    std::vector<std::vector<float>> log, value, subtreeMax;
+  };
+
+  // Part of a ray in one leaf cell, between distances t0 and t1
+  struct Segment {
+    double t0, t1;
+    float value;
+    bool operator<(const Segment& o) const { return t0 < o.t0; }
+  };
+
+  std::unique_ptr<RAMSES::snapshot> m_snap;
+  std::vector<Domain> m_domains;
+  int m_numLevels{0};
+
+  float m_logMin{0.0f}, m_logMax{1.0f};
+  float m_opacity{50.0f};
+
+  // Recompute transfer values and subtree maxima after a range change
+  void updateTransfer();
+
+  // Append the segments of the ray in [tmin, tmax] through the non-transparent
+  // leaf cells of a domain; path caches the octs from the coarse level down to
+  // the last visited cell and is reused by the next ray of the tile
+  void trace(const Domain& domain, const double origin[3], const double dir[3], double tmin, double tmax,
+             std::vector<unsigned>& path, int& depth, std::vector<Segment>& segments) const;
+};
@@ -9,6 +9,15 @@ public:
 	Particle(glm::vec3 position);
 
 	glm::vec3 position;
+	// Velocity in code units, 0 unless read for motion interpolation
+	glm::vec3 velocity;
+	// RAMSES particle_ID, identifies the particle across snapshots
+	long long id;
+
+	// Gas properties of the enclosing AMR leaf cell, gasDensity is 0 if not sampled
+	float gasDensity;
+	float gasTemperature;
+	glm::vec3 gasVelocity;
 
 	virtual ~Particle();
 };
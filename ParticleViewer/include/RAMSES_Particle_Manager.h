@@ -18,12 +18,21 @@
 class RAMSES_Particle_Manager
 {
 public:
-	RAMSES_Particle_Manager(std::string filename);
+	// With withGas set, the gas density, temperature and velocity of the
+	// enclosing AMR leaf cell are attached to every particle. With withMotion
+	// set, the particle velocities are read as well
+	RAMSES_Particle_Manager(std::string filename, bool withGas = false, bool withMotion = false);
 
     int npart;
     // Number of particles to draw (capped in constructor)
     int npartDraw;
+	// Time stamp and box length of the snapshot in code units
+	double time;
+	double boxlen;
 	GLfloat *particlesArray();
+	// Log gas density of the drawn particles scaled to [0,1], -1 where no gas was sampled
+	GLfloat *gasArray();
+	bool hasGas;
 	std::vector<Particle> mParticleArray;
 
 	~RAMSES_Particle_Manager();
@@ -24,6 +24,7 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <vector>
 #include <stdexcept>
 #include <iterator>
@@ -233,6 +234,38 @@ public:
 		
 	}
 	
+	//! read a record of known length directly into preallocated memory
+	/*! a std::runtime_error is thrown if the record does not contain exactly n elements
+	 * @param data pointer to memory for n elements
+	 * @param n number of elements expected in the record
+	 */
+	template< typename basetype >
+	void read_n( basetype* data, size_t n )
+	{
+		unsigned n1,n2;
+		try{
+			m_ifs.read( (char*)&n1, m_addlen );
+		}catch(...){
+			throw std::runtime_error("FortranUnformatted::read_n : error reading FORTRAN unformatted.");
+		}
+		//... checked outside the try block so that the diagnosis is not replaced ...//
+		if( n1 != n*sizeof(basetype) ){
+			std::ostringstream msg;
+			msg << "FortranUnformatted::read_n : unexpected record size, " << n1 << " bytes instead of "
+				<< n*sizeof(basetype) << ".";
+			throw std::runtime_error(msg.str());
+		}
+		try{
+			m_ifs.read( (char*)data, n1 );
+			m_ifs.read( (char*)&n2, m_addlen );
+		}catch(...){
+			throw std::runtime_error("FortranUnformatted::read_n : error reading FORTRAN unformatted.");
+		}
+		if( n1!=n2 )
+			throw std::runtime_error("FortranUnformatted::read_n : invalid type conversion when"\
+						" reading FORTRAN unformatted.");
+	}
+
 	//! check if beyond end-of-file
 	bool eof( void )
 	{
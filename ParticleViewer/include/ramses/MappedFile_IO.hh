@@ -0,0 +1,148 @@
+/*
+	MappedFile_IO.hh
+	This file contains a C++ class for read-only memory mapped file access
+
+    It is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MAPPED_FILE_HH
+#define __MAPPED_FILE_HH
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//! A class providing read-only memory mapped access to a whole file
+/*! MappedFile maps a file into the address space of the process so that
+    large binary payloads can be accessed without intermediate stream reads.
+    The mapping is released when the object is destroyed.
+ */
+class MappedFile{
+
+protected:
+	std::string m_filename;		//!< the file name
+	const char* m_data;			//!< start of the mapped region
+	size_t      m_size;			//!< size of the mapped region in bytes
+
+#ifdef _WIN32
+	HANDLE m_hfile;				//!< file handle
+	HANDLE m_hmap;				//!< file mapping handle
+#endif
+
+private:
+	MappedFile( const MappedFile& );
+	MappedFile& operator=( const MappedFile& );
+
+public:
+
+	//! constructor for MappedFile
+	/*! maps the file given by filename for read access,
+	 *  throws a std::runtime_error if this fails
+	 * @param filename the name of the file to be mapped
+	 */
+	explicit MappedFile( std::string filename )
+		: m_filename( filename ), m_data( NULL ), m_size( 0 )
+	{
+#ifdef _WIN32
+		m_hmap  = NULL;
+		m_hfile = CreateFileA( m_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+								OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+		if( m_hfile == INVALID_HANDLE_VALUE )
+			throw std::runtime_error("MappedFile : unable to open file \'"+m_filename+"\' for read access");
+
+		LARGE_INTEGER sz;
+		GetFileSizeEx( m_hfile, &sz );
+		m_size = (size_t)sz.QuadPart;
+		if( m_size == 0 ) return;
+
+		m_hmap = CreateFileMappingA( m_hfile, NULL, PAGE_READONLY, 0, 0, NULL );
+		if( m_hmap != NULL )
+			m_data = (const char*)MapViewOfFile( m_hmap, FILE_MAP_READ, 0, 0, 0 );
+		if( m_data == NULL ){
+			release();
+			throw std::runtime_error("MappedFile : unable to map file \'"+m_filename+"\'");
+		}
+#else
+		int fd = open( m_filename.c_str(), O_RDONLY );
+		if( fd < 0 )
+			throw std::runtime_error("MappedFile : unable to open file \'"+m_filename+"\' for read access");
+
+		struct stat st;
+		if( fstat( fd, &st ) != 0 ){
+			close( fd );
+			throw std::runtime_error("MappedFile : unable to stat file \'"+m_filename+"\'");
+		}
+		m_size = (size_t)st.st_size;
+		if( m_size > 0 ){
+			void* p = mmap( NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( p == MAP_FAILED ){
+				close( fd );
+				throw std::runtime_error("MappedFile : unable to map file \'"+m_filename+"\'");
+			}
+			m_data = (const char*)p;
+			madvise( p, m_size, MADV_SEQUENTIAL );
+		}
+		//... the mapping stays valid after the descriptor is closed ...//
+		close( fd );
+#endif
+	}
+
+	//! destructor, unmaps the file
+	~MappedFile()
+	{ release(); }
+
+	//! pointer to the first byte of the mapped file
+	const char* data( void ) const
+	{ return m_data; }
+
+	//! size of the mapped file in bytes
+	size_t size( void ) const
+	{ return m_size; }
+
+	//! name of the mapped file
+	const std::string& filename( void ) const
+	{ return m_filename; }
+
+protected:
+
+	//! release mapping and file handles
+	void release( void )
+	{
+#ifdef _WIN32
+		if( m_data != NULL ) UnmapViewOfFile( m_data );
+		if( m_hmap != NULL ) CloseHandle( m_hmap );
+		if( m_hfile != INVALID_HANDLE_VALUE ) CloseHandle( m_hfile );
+		m_hmap  = NULL;
+		m_hfile = INVALID_HANDLE_VALUE;
+#else
+		if( m_data != NULL ) munmap( (void*)m_data, m_size );
+#endif
+		m_data = NULL;
+	}
+};
+
+
+#endif //__MAPPED_FILE_HH
@@ -27,10 +27,15 @@
 #include <iomanip>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iterator>
+#include <type_traits>
+#include <sys/stat.h>
 
 #include "FortranUnformatted_IO.hh"
+#include "MappedFile_IO.hh"
 #include "RAMSES_info.hh"
 #include "RAMSES_amr_data.hh"
 
@@ -45,6 +50,9 @@
 #define LENGTH_POINTERLISTS 4096
 #define ENDPOINT ((unsigned)(-1))
 
+#define TREE_CACHE_MAGIC   "RAMSESAT"
+#define TREE_CACHE_VERSION 1
+
 namespace RAMSES{
 namespace AMR{
 	
@@ -69,6 +77,44 @@ struct vec{
 	{ }
 };
 
+//! reference to a single cell in the tree: level, oct index on that level and child index
+struct cell_ref{
+	unsigned m_ilevel;		//!< refinement level of the oct
+	unsigned m_igrid;		//!< index of the oct on its level
+	unsigned m_ind;			//!< index of the child cell in the oct (0..7)
+
+	cell_ref( unsigned ilevel, unsigned igrid, unsigned ind )
+	: m_ilevel(ilevel), m_igrid(igrid), m_ind(ind)
+	{ }
+
+	cell_ref( void )
+	: m_ilevel(0), m_igrid(0), m_ind(0)
+	{ }
+};
+
+//! spread the lower 21 bits of an integer so that two zero bits separate each bit
+inline unsigned long long morton_spread21( unsigned long long v )
+{
+	v &= 0x1fffffULL;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v <<  8) & 0x100f00f00f00f00fULL;
+	v = (v | v <<  4) & 0x10c30c30c30c30c3ULL;
+	v = (v | v <<  2) & 0x1249249249249249ULL;
+	return v;
+}
+
+//! 63 bit Morton key of a position in box units [0,1), 21 bits per dimension
+inline unsigned long long morton_key3d( double x, double y, double z )
+{
+	const double scale = (double)(1<<21);
+	double c[3] = { x*scale, y*scale, z*scale };
+	unsigned long long ic[3];
+	for( int i=0; i<3; ++i )
+		ic[i] = c[i] <= 0.0 ? 0ULL : (c[i] >= scale ? (unsigned long long)(scale-1.0) : (unsigned long long)c[i]);
+	return morton_spread21(ic[0]) | morton_spread21(ic[1]) << 1 | morton_spread21(ic[2]) << 2;
+}
+
 /**************************************************************************************\
  *** AMR cell base types **************************************************************
 \**************************************************************************************/
@@ -211,6 +257,9 @@ class tree
 {
 
 public:
+
+	typedef Cell_ cell_type;		//!< type of the octs stored in the tree
+	typedef Level_ level_type;		//!< type of the per-level oct containers
 	
 	//! header amr meta-data structure, for details see also RAMSES source code (file amr/init_amr.f90)
 	struct header{ 
@@ -245,6 +294,7 @@ public:
 	int m_cpu;							//! index of computational domain being accessed
 	int m_minlevel;						//! lowest refinement level to be loaded
 	int m_maxlevel;						//! highest refinement level to be loaded
+	int m_req_maxlevel;					//! highest refinement level requested at construction
 	std::string m_fname;				//! the snapshot filename amr_XXXXX.out
 	unsigned m_ncoarse;					//! number of coarse grids
 	struct header m_header;				//! the header meta data
@@ -477,6 +527,37 @@ protected:
 	//! generate the amr_XXXXX.out filename from the path to the info_XXXXX.out file
 	std::string rename_info2amr( const std::string& info );
 
+	//! header of the binary tree cache file, followed by headl, numbl, taill,
+	//! the number of cells per level and the raw cell data of all levels
+	struct cache_header{
+		char      magic[8];			//!< file identifier TREE_CACHE_MAGIC
+		long long src_size;			//!< size of the amr_XXXXX.outYYYYY file the cache was built from
+		long long src_mtime;		//!< modification time of the amr_XXXXX.outYYYYY file
+		unsigned  version;			//!< cache format version TREE_CACHE_VERSION
+		unsigned  cell_size;		//!< sizeof(Cell_) of the writer
+		unsigned  locally_essential;//!< whether neighbour/father links are stored
+		int       cpu;				//!< domain of the tree
+		int       req_maxlevel;		//!< maximum level requested before reading
+		int       maxlevel;			//!< maximum level actually read
+		unsigned  ncoarse;			//!< number of coarse grids
+		unsigned  nheadl;			//!< number of entries in m_headl
+		unsigned  nnumbl;			//!< number of entries in m_numbl
+		unsigned  ntaill;			//!< number of entries in m_taill
+		unsigned  nlevels;			//!< number of levels stored
+		unsigned  reserved;			//!< padding, zero
+	};
+
+	//! get size and modification time of a file, returns false if it cannot be accessed
+	static bool file_stamp( const std::string& fname, long long& size, long long& mtime )
+	{
+		struct stat st;
+		if( stat( fname.c_str(), &st ) != 0 )
+			return false;
+		size  = (long long)st.st_size;
+		mtime = (long long)st.st_mtime;
+		return true;
+	}
+
 
 	#define R_SQR(x) ((x)*(x))
 	
@@ -594,7 +675,8 @@ public:
 	 * @param minlevel minimum refinement level to consider (default=1)
 	 */
 	tree( RAMSES::snapshot& snap, int cpu, int maxlevel, int minlevel=1 )
-	: m_cpu( cpu ), m_minlevel( minlevel ), m_maxlevel( maxlevel ), m_fname( rename_info2amr(snap.m_filename) )
+	: m_cpu( cpu ), m_minlevel( minlevel ), m_maxlevel( maxlevel ), m_req_maxlevel( maxlevel ),
+	  m_fname( rename_info2amr(snap.m_filename) )
 	{ 
 		read_header();
 
@@ -605,6 +687,34 @@ public:
 	
 	//! perform the read operation of AMR data
 	void read( void );
+
+	//! perform the read operation of AMR data through a binary cache file
+	/*! restores the tree from the cache file if it is valid for the
+	 *  amr_XXXXX.outYYYYY file and the requested level range, otherwise
+	 *  calls read() and (re-)writes the cache file.
+	 * @param cache_fname path and name of the cache file
+	 * @return true if the tree was restored from the cache
+	 */
+	bool read_cached( const std::string& cache_fname );
+
+	//! write the decoded tree to a versioned binary cache file
+	/*!
+	 * @param cache_fname path and name of the cache file
+	 * @return false if the file could not be written
+	 */
+	bool save_cache( const std::string& cache_fname );
+
+	//! restore the tree from a binary cache file written by save_cache()
+	/*! the cache file is memory mapped and the cell data is copied level by level,
+	 *  no parsing of the amr_XXXXX.outYYYYY file is done.
+	 * @param cache_fname path and name of the cache file
+	 * @return false if the cache file is missing, outdated or incompatible
+	 */
+	bool read_cache( const std::string& cache_fname );
+
+	//! default name of the cache file, placed next to the amr file of the domain
+	std::string default_cache_fname( void )
+	{ return gen_fname( m_cpu )+".tree"; }
 	
 	//! end const_iterator for given refinement level
 	const_iterator end( int ilevel ) const
@@ -674,6 +784,116 @@ public:
 		return pos;
 	}
 	
+	//! return the center of a cell given by a cell reference
+	/*!
+	 * @param c cell reference, e.g. from one of the query functions
+	 * @return vec vector containing the coordinates
+	 */
+	template< typename Real_ >
+	inline vec<Real_> cell_pos( const cell_ref& c ) const
+	{
+		const Level_& lvl = m_AMR_levels[c.m_ilevel];
+		const Cell_& oct  = lvl.m_level_cells[c.m_igrid];
+		return vec<Real_>( oct.m_xg[0]+lvl.m_xc[c.m_ind], oct.m_xg[1]+lvl.m_yc[c.m_ind], oct.m_xg[2]+lvl.m_zc[c.m_ind] );
+	}
+
+	//! hierarchical query for leaf cells passing a geometric test
+	/*! descends from the coarsest level through the son links and prunes all
+	 *  subtrees whose oct or cell fails the test. Matching leaf cells are appended
+	 *  sorted by level and oct index, i.e. in memory order of the tree and hydro arrays.
+	 *  Cells on the finest loaded level count as leaves.
+	 * @param test functor test( const vec<Real_>& center, double half_size ) returning true if the box may contain matches
+	 * @param cells vector to which the matching leaf cells are appended
+	 * @param owned_only if true, only leaves belonging to the domain of this tree are returned
+	 */
+	template< typename Real_, typename Test_ >
+	void query_leaf_cells( const Test_& test, std::vector<cell_ref>& cells, bool owned_only=true );
+
+	//! query all leaf cells intersecting a ball
+	/*!
+	 * @param xc center of the ball
+	 * @param r2 squared radius of the ball
+	 * @param cells vector to which the matching leaf cells are appended
+	 * @param owned_only if true, only leaves belonging to the domain of this tree are returned
+	 */
+	template< typename Real_ >
+	void query_ball( const vec<Real_>& xc, Real_ r2, std::vector<cell_ref>& cells, bool owned_only=true )
+	{
+		query_leaf_cells<Real_>( [&]( const vec<Real_>& xg, double dx2 ){ return ball_intersection( xg, dx2, xc, r2 ); },
+								 cells, owned_only );
+	}
+
+	//! query all leaf cells intersecting a spherical shell
+	/*!
+	 * @param xc center of the shell
+	 * @param r1_2 squared inner radius of the shell
+	 * @param r2_2 squared outer radius of the shell
+	 * @param cells vector to which the matching leaf cells are appended
+	 * @param owned_only if true, only leaves belonging to the domain of this tree are returned
+	 */
+	template< typename Real_ >
+	void query_shell( const vec<Real_>& xc, Real_ r1_2, Real_ r2_2, std::vector<cell_ref>& cells, bool owned_only=true )
+	{
+		query_leaf_cells<Real_>( [&]( const vec<Real_>& xg, double dx2 ){ return shell_intersection( xg, dx2, xc, r1_2, r2_2 ); },
+								 cells, owned_only );
+	}
+
+	//! query all leaf cells intersected by the surface of a sphere
+	/*!
+	 * @param xc center of the sphere
+	 * @param r2 squared radius of the sphere
+	 * @param cells vector to which the matching leaf cells are appended
+	 * @param owned_only if true, only leaves belonging to the domain of this tree are returned
+	 */
+	template< typename Real_ >
+	void query_sphere( const vec<Real_>& xc, Real_ r2, std::vector<cell_ref>& cells, bool owned_only=true )
+	{
+		query_leaf_cells<Real_>( [&]( const vec<Real_>& xg, double dx2 ){ return sphere_intersection( xg, dx2, xc, r2 ); },
+								 cells, owned_only );
+	}
+
+	//! locate the leaf cells containing a batch of points
+	/*! the points are processed in Morton order so that consecutive lookups reuse
+	 *  the path from the coarse level, chunks of points are distributed over threads.
+	 *  Points not covered by the loaded tree obtain a cell_ref with m_igrid==ENDPOINT.
+	 * @param x array of n x-coordinates in box units [0,1)
+	 * @param y array of n y-coordinates in box units [0,1)
+	 * @param z array of n z-coordinates in box units [0,1)
+	 * @param n number of points
+	 * @param cells vector receiving one cell reference per point, in input order
+	 */
+	template< typename Real_ >
+	void locate_points( const Real_* x, const Real_* y, const Real_* z, size_t n, std::vector<cell_ref>& cells ) const;
+
+	//! locate the leaf cell containing a point, reusing the path of the previous lookup
+	/*! consecutive lookups of nearby points only climb as far as needed before descending again
+	 * @param p point coordinates in box units [0,1)
+	 * @param path octs from the coarse level to the previously located cell, updated
+	 * @param depth depth of the cached path, -1 if there is none, updated
+	 * @return reference to the leaf cell, m_igrid==ENDPOINT if the point is not covered
+	 */
+	cell_ref locate_cached( const double p[3], std::vector<unsigned>& path, int& depth ) const;
+
+	//! locate the leaf cells containing a batch of points, e.g. particle positions
+	/*!
+	 * @param x vector of x-coordinates in box units [0,1)
+	 * @param y vector of y-coordinates in box units [0,1)
+	 * @param z vector of z-coordinates in box units [0,1)
+	 * @param cells vector receiving one cell reference per point, in input order
+	 */
+	template< typename Real_ >
+	void locate_points( const std::vector<Real_>& x, const std::vector<Real_>& y, const std::vector<Real_>& z,
+						std::vector<cell_ref>& cells ) const
+	{
+		if( x.size() != y.size() || x.size() != z.size() )
+			throw std::runtime_error("RAMSES::AMR::tree::locate_points : coordinate arrays differ in size.");
+		if( x.empty() ){
+			cells.clear();
+			return;
+		}
+		locate_points( &x[0], &y[0], &z[0], x.size(), cells );
+	}
+
 	template< typename Real_ >
 	inline bool ball_intersects_grid( const iterator& it, const vec<Real_>& xc, Real_ r2 )
 	{
@@ -965,6 +1185,284 @@ void tree<Cell_,Level_>::read( void )
 	}
 }
 
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< class Cell_, class Level_ >
+template< typename Real_, typename Test_ >
+void tree<Cell_,Level_>::query_leaf_cells( const Test_& test, std::vector<cell_ref>& cells, bool owned_only )
+{
+	if( !is_locally_essential<Cell_>::check )
+		throw std::runtime_error("RAMSES::AMR::tree::query_leaf_cells : hierarchical queries require son links (cell_locally_essential).");
+
+	if( m_AMR_levels.empty() )
+		return;
+
+	//... octs to be tested on the current and the next finer level ...//
+	std::vector<unsigned> current, next;
+	for( unsigned i=0; i<m_AMR_levels[0].size(); ++i )
+		current.push_back( i );
+
+	for( int ilvl=0; ilvl<=m_maxlevel && !current.empty(); ++ilvl ){
+		Level_& lvl = m_AMR_levels[ilvl];
+		double dx2_grid = ldexp( 0.5, -ilvl );
+		double dx2_cell = 0.5*dx2_grid;
+		bool has_finer  = ilvl < m_maxlevel && ilvl+1 < (int)m_AMR_levels.size();
+		unsigned nfiner = has_finer? m_AMR_levels[ilvl+1].size() : 0;
+
+		next.clear();
+		for( unsigned i=0; i<current.size(); ++i ){
+			unsigned igrid = current[i];
+			const Cell_& oct = lvl.m_level_cells[igrid];
+			vec<Real_> xg( oct.m_xg[0], oct.m_xg[1], oct.m_xg[2] );
+
+			if( !test( xg, dx2_grid ) )
+				continue;
+
+			for( unsigned ind=0; ind<8; ++ind ){
+				vec<Real_> xcell( xg.x+lvl.m_xc[ind], xg.y+lvl.m_yc[ind], xg.z+lvl.m_zc[ind] );
+				if( !test( xcell, dx2_cell ) )
+					continue;
+
+				if( has_finer && oct.is_refined(ind) && oct.m_son[ind] < nfiner )
+					next.push_back( oct.m_son[ind] );
+				else if( !owned_only || (int)oct.m_cpu == m_cpu )
+					cells.push_back( cell_ref( ilvl, igrid, ind ) );
+			}
+		}
+
+		//... visit the next level in memory order ...//
+		std::sort( next.begin(), next.end() );
+		current.swap( next );
+	}
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< class Cell_, class Level_ >
+template< typename Real_ >
+void tree<Cell_,Level_>::locate_points( const Real_* x, const Real_* y, const Real_* z, size_t n, std::vector<cell_ref>& cells ) const
+{
+	if( !is_locally_essential<Cell_>::check )
+		throw std::runtime_error("RAMSES::AMR::tree::locate_points : point location requires son links (cell_locally_essential).");
+
+	cells.assign( n, cell_ref( 0, ENDPOINT, 0 ) );
+	if( n == 0 || m_AMR_levels.empty() )
+		return;
+
+	long long np = (long long)n;
+
+	//... sort the points along a Morton curve ...//
+	std::vector< std::pair<unsigned long long,unsigned> > order( n );
+
+	#pragma omp parallel for
+	for( long long i=0; i<np; ++i )
+		order[i] = std::make_pair( morton_key3d( x[i], y[i], z[i] ), (unsigned)i );
+
+	std::sort( order.begin(), order.end() );
+
+	int nlevels = std::min( m_maxlevel+1, (int)m_AMR_levels.size() );
+
+	const long long chunk_size = 4096;
+	long long nchunks = (np+chunk_size-1)/chunk_size;
+
+	#pragma omp parallel for schedule(dynamic)
+	for( long long ichunk=0; ichunk<nchunks; ++ichunk ){
+		//... path from the coarse level to the leaf of the previous point ...//
+		std::vector<unsigned> path( nlevels );
+		int depth = -1;
+
+		long long iend = std::min( np, (ichunk+1)*chunk_size );
+		for( long long i=ichunk*chunk_size; i<iend; ++i ){
+			unsigned ip = order[i].second;
+			double p[3] = { x[ip], y[ip], z[ip] };
+			cells[ip] = locate_cached( p, path, depth );
+		}
+	}
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< class Cell_, class Level_ >
+cell_ref tree<Cell_,Level_>::locate_cached( const double p[3], std::vector<unsigned>& path, int& depth ) const
+{
+	int nlevels = std::min( m_maxlevel+1, (int)m_AMR_levels.size() );
+	if( (int)path.size() < nlevels )
+		path.resize( nlevels );
+
+	//... move up until the oct on the path contains the point ...//
+	while( depth >= 0 ){
+		const Cell_& oct = m_AMR_levels[depth].m_level_cells[path[depth]];
+		double h = ldexp( 0.5, -depth );
+		if( p[0] >= oct.m_xg[0]-h && p[0] < oct.m_xg[0]+h
+		 && p[1] >= oct.m_xg[1]-h && p[1] < oct.m_xg[1]+h
+		 && p[2] >= oct.m_xg[2]-h && p[2] < oct.m_xg[2]+h )
+			break;
+		--depth;
+	}
+
+	if( depth < 0 ){
+		if( nlevels < 1 )
+			return cell_ref( 0, ENDPOINT, 0 );
+		const Level_& lvl = m_AMR_levels[0];
+		for( unsigned igrid=0; igrid<lvl.m_level_cells.size(); ++igrid ){
+			const Cell_& oct = lvl.m_level_cells[igrid];
+			if( p[0] >= oct.m_xg[0]-0.5 && p[0] < oct.m_xg[0]+0.5
+			 && p[1] >= oct.m_xg[1]-0.5 && p[1] < oct.m_xg[1]+0.5
+			 && p[2] >= oct.m_xg[2]-0.5 && p[2] < oct.m_xg[2]+0.5 ){
+				path[0] = igrid;
+				depth = 0;
+				break;
+			}
+		}
+		if( depth < 0 )
+			return cell_ref( 0, ENDPOINT, 0 );
+	}
+
+	//... descend to the leaf ...//
+	while( true ){
+		const Cell_& oct = m_AMR_levels[depth].m_level_cells[path[depth]];
+		unsigned ind = (p[0]>=oct.m_xg[0]) + 2*(p[1]>=oct.m_xg[1]) + 4*(p[2]>=oct.m_xg[2]);
+		if( depth+1 < nlevels && oct.is_refined(ind) && oct.m_son[ind] < m_AMR_levels[depth+1].m_level_cells.size() ){
+			++depth;
+			path[depth] = oct.m_son[ind];
+		}else
+			return cell_ref( depth, path[depth], ind );
+	}
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< class Cell_, class Level_ >
+bool tree<Cell_,Level_>::save_cache( const std::string& cache_fname )
+{
+	static_assert( std::is_trivially_copyable<Cell_>::value, "tree cache requires trivially copyable cells" );
+
+	cache_header hdr;
+	std::memset( &hdr, 0, sizeof(cache_header) );
+	std::memcpy( hdr.magic, TREE_CACHE_MAGIC, 8 );
+	if( !file_stamp( gen_fname(m_cpu), hdr.src_size, hdr.src_mtime ) )
+		return false;
+
+	hdr.version           = TREE_CACHE_VERSION;
+	hdr.cell_size         = sizeof(Cell_);
+	hdr.locally_essential = is_locally_essential<Cell_>::check;
+	hdr.cpu               = m_cpu;
+	hdr.req_maxlevel      = m_req_maxlevel;
+	hdr.maxlevel          = m_maxlevel;
+	hdr.ncoarse           = m_ncoarse;
+	hdr.nheadl            = m_headl.size();
+	hdr.nnumbl            = m_numbl.size();
+	hdr.ntaill            = m_taill.size();
+	hdr.nlevels           = m_AMR_levels.size();
+
+	std::vector<unsigned> level_size;
+	for( unsigned ilvl=0; ilvl<m_AMR_levels.size(); ++ilvl )
+		level_size.push_back( m_AMR_levels[ilvl].size() );
+
+	std::ofstream ofs( cache_fname.c_str(), std::ios::binary|std::ios::trunc );
+	if( !ofs.good() )
+		return false;
+
+	ofs.write( (const char*)&hdr, sizeof(cache_header) );
+	if( !m_headl.empty() )    ofs.write( (const char*)&m_headl[0], m_headl.size()*sizeof(unsigned) );
+	if( !m_numbl.empty() )    ofs.write( (const char*)&m_numbl[0], m_numbl.size()*sizeof(unsigned) );
+	if( !m_taill.empty() )    ofs.write( (const char*)&m_taill[0], m_taill.size()*sizeof(unsigned) );
+	if( !level_size.empty() ) ofs.write( (const char*)&level_size[0], level_size.size()*sizeof(unsigned) );
+
+	//... one contiguous write per level ...//
+	for( unsigned ilvl=0; ilvl<m_AMR_levels.size(); ++ilvl )
+		if( level_size[ilvl] > 0 )
+			ofs.write( (const char*)&m_AMR_levels[ilvl].m_level_cells[0], level_size[ilvl]*sizeof(Cell_) );
+
+	return ofs.good();
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< class Cell_, class Level_ >
+bool tree<Cell_,Level_>::read_cache( const std::string& cache_fname )
+{
+	long long cache_size, cache_mtime, src_size, src_mtime;
+	if( !file_stamp( cache_fname, cache_size, cache_mtime ) || !file_stamp( gen_fname(m_cpu), src_size, src_mtime ) )
+		return false;
+
+	MappedFile mf( cache_fname );
+	if( mf.size() < sizeof(cache_header) )
+		return false;
+
+	cache_header hdr;
+	std::memcpy( &hdr, mf.data(), sizeof(cache_header) );
+
+	if( std::memcmp( hdr.magic, TREE_CACHE_MAGIC, 8 ) != 0 || hdr.version != TREE_CACHE_VERSION
+		|| hdr.cell_size != sizeof(Cell_) || hdr.locally_essential != (unsigned)is_locally_essential<Cell_>::check
+		|| hdr.cpu != m_cpu || hdr.req_maxlevel != m_req_maxlevel
+		|| hdr.src_size != src_size || hdr.src_mtime != src_mtime )
+		return false;
+
+	//... check that the payload is complete before touching it ...//
+	size_t nhead = (size_t)hdr.nheadl+hdr.nnumbl+hdr.ntaill+hdr.nlevels;
+	if( mf.size() < sizeof(cache_header)+nhead*sizeof(unsigned) )
+		return false;
+
+	const unsigned* pu = (const unsigned*)(mf.data()+sizeof(cache_header));
+	const unsigned* level_size = pu+hdr.nheadl+hdr.nnumbl+hdr.ntaill;
+	size_t ncells = 0;
+	for( unsigned ilvl=0; ilvl<hdr.nlevels; ++ilvl )
+		ncells += level_size[ilvl];
+	if( mf.size() != sizeof(cache_header)+nhead*sizeof(unsigned)+ncells*sizeof(Cell_) )
+		return false;
+
+	m_headl.assign( pu, pu+hdr.nheadl );
+	pu += hdr.nheadl;
+	m_numbl.assign( pu, pu+hdr.nnumbl );
+	pu += hdr.nnumbl;
+	m_taill.assign( pu, pu+hdr.ntaill );
+
+	m_minlevel = 0;
+	m_maxlevel = hdr.maxlevel;
+	m_ncoarse  = hdr.ncoarse;
+
+	const char* pcell = (const char*)(level_size+hdr.nlevels);
+	m_AMR_levels.clear();
+	m_AMR_levels.reserve( hdr.nlevels );
+	for( unsigned ilvl=0; ilvl<hdr.nlevels; ++ilvl ){
+		m_AMR_levels.push_back( Level_(ilvl) );
+		Level_ &currlvl = m_AMR_levels.back();
+		currlvl.m_level_cells.resize( level_size[ilvl] );
+		if( level_size[ilvl] > 0 )
+			std::memcpy( (void*)&currlvl.m_level_cells[0], pcell, level_size[ilvl]*sizeof(Cell_) );
+		pcell += level_size[ilvl]*sizeof(Cell_);
+	}
+
+	return true;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< class Cell_, class Level_ >
+bool tree<Cell_,Level_>::read_cached( const std::string& cache_fname )
+{
+	try{
+		if( read_cache( cache_fname ) )
+			return true;
+	}catch( std::exception& e ){
+		std::cerr << "RAMSES::AMR::tree::read_cached : ignoring cache file. " << e.what() << std::endl;
+	}
+
+	read();
+
+	if( !save_cache( cache_fname ) )
+		std::cerr << "RAMSES::AMR::tree::read_cached : could not write cache file \'" << cache_fname << "\'" << std::endl;
+
+	return false;
+}
+
 } //namespace AMR
 } //namespace RAMSES
 
@@ -0,0 +1,405 @@
+/*
+		This file is part of libRAMSES++
+			a C++ library to access snapshot files
+			generated by the simulation code RAMSES by R. Teyssier
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RAMSES_CATALOG_HH
+#define __RAMSES_CATALOG_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "RAMSES_info.hh"
+
+#define CATALOG_INDEX_MAGIC   "RAMSESSC"
+#define CATALOG_INDEX_VERSION 1
+
+namespace RAMSES{
+
+//! meta data of one snapshot of a simulation, as held by a catalog
+struct catalog_entry{
+	unsigned  nout;					//!< output number XXXXX of output_XXXXX
+	long long info_size;			//!< size of the info_XXXXX.txt file when it was parsed
+	long long info_mtime;			//!< modification time of the info_XXXXX.txt file when it was parsed
+	long long amr_bytes;			//!< total size of the amr_XXXXX.outYYYYY files
+	long long hydro_bytes;			//!< total size of the hydro_XXXXX.outYYYYY files
+	long long part_bytes;			//!< total size of the part_XXXXX.outYYYYY files
+	snapshot::info_data header;		//!< header data of the info file (aexp, time, ncpu, levelmax, ...)
+	std::vector<double> ind_min;	//!< minimum hilbert ordering indices for each domain
+	std::vector<double> ind_max;	//!< maximum hilbert ordering indices for each domain
+	std::string info_fname;			//!< path and name of the info_XXXXX.txt file
+};
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+/*!
+ * @class RAMSES::catalog
+ * @brief index of all snapshots of a simulation
+ *
+ * The catalog scans a simulation directory for output_XXXXX/info_XXXXX.txt
+ * files and parses them in parallel. The results are kept in a versioned
+ * binary index file in the simulation directory, so that later scans only
+ * parse info files that are new or have changed since.
+ */
+class catalog{
+
+protected:
+
+	//! header of the binary index file, followed by the entries
+	struct index_header{
+		char      magic[8];		//!< file identifier CATALOG_INDEX_MAGIC
+		unsigned  version;		//!< index format version CATALOG_INDEX_VERSION
+		unsigned  info_size;	//!< sizeof(snapshot::info_data) of the writer
+		unsigned  nentries;		//!< number of entries stored
+		unsigned  reserved;		//!< padding, zero
+	};
+
+	//! list the names of the entries of a directory
+	static bool list_directory( const std::string& dir, std::vector<std::string>& names );
+
+	//! get size and modification time of a file, returns false if it cannot be accessed
+	static bool file_stamp( const std::string& fname, long long& size, long long& mtime )
+	{
+		struct stat st;
+		if( stat( fname.c_str(), &st ) != 0 )
+			return false;
+		size  = (long long)st.st_size;
+		mtime = (long long)st.st_mtime;
+		return true;
+	}
+
+	//! parse the info file of an entry and sum up the sizes of its data files
+	void parse_entry( catalog_entry& e );
+
+public:
+
+	std::string m_dir;							//!< the simulation directory
+	codeversion m_version;						//!< the RAMSES version of the snapshots
+	std::vector<catalog_entry> m_entries;		//!< all snapshots found, sorted by output number
+
+	//! constructor, scans the simulation directory
+	/*! entries of the index file are reused if their info file is unchanged,
+	 *  the index file is rewritten if any snapshot had to be parsed
+	 * @param dir the simulation directory containing the output_XXXXX directories
+	 * @param ver the RAMSES version of the snapshots
+	 * @param use_index whether to read and write the index file
+	 */
+	explicit catalog( std::string dir, codeversion ver=RAMSES::version3, bool use_index=true );
+
+	//! number of snapshots in the catalog
+	size_t size( void ) const
+	{ return m_entries.size(); }
+
+	//! access the meta data of a snapshot
+	const catalog_entry& operator[]( size_t i ) const
+	{ return m_entries.at(i); }
+
+	//! find the entry of an output number, returns size() if it is not in the catalog
+	size_t find( unsigned nout ) const
+	{
+		for( size_t i=0; i<m_entries.size(); ++i )
+			if( m_entries[i].nout == nout )
+				return i;
+		return m_entries.size();
+	}
+
+	//! create a snapshot object from the catalog without reparsing its info file
+	/*! the caller takes ownership of the returned object
+	 * @param i index of the entry
+	 */
+	snapshot* open( size_t i ) const
+	{
+		const catalog_entry& e = m_entries.at(i);
+		return new snapshot( e.info_fname, e.header, e.ind_min, e.ind_max, m_version );
+	}
+
+	//! default name of the index file, placed in the simulation directory
+	std::string default_index_fname( void ) const
+	{ return m_dir+"/snapshot_catalog.idx"; }
+
+	//! read entries from a binary index file
+	/*!
+	 * @param fname path and name of the index file
+	 * @param entries the entries of the index on return
+	 * @return false if the index file is missing or incompatible
+	 */
+	bool read_index( const std::string& fname, std::vector<catalog_entry>& entries );
+
+	//! write all entries to a binary index file
+	/*!
+	 * @param fname path and name of the index file
+	 * @return true on success
+	 */
+	bool save_index( const std::string& fname ) const;
+
+	//! check whether a path is a simulation directory containing output_XXXXX directories
+	static bool is_simulation_dir( const std::string& path )
+	{
+		std::vector<std::string> names;
+		if( !list_directory( path, names ) )
+			return false;
+		unsigned nout;
+		for( size_t i=0; i<names.size(); ++i )
+			if( names[i].size() == 12 && sscanf( names[i].c_str(), "output_%05u", &nout ) == 1 )
+				return true;
+		return false;
+	}
+};
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+inline bool catalog::list_directory( const std::string& dir, std::vector<std::string>& names )
+{
+	names.clear();
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA( (dir+"\\*").c_str(), &fd );
+	if( h == INVALID_HANDLE_VALUE )
+		return false;
+	do{
+		names.push_back( fd.cFileName );
+	}while( FindNextFileA( h, &fd ) );
+	FindClose( h );
+#else
+	DIR* d = opendir( dir.c_str() );
+	if( d == NULL )
+		return false;
+	struct dirent* de;
+	while( (de = readdir( d )) != NULL )
+		names.push_back( de->d_name );
+	closedir( d );
+#endif
+	return true;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+inline void catalog::parse_entry( catalog_entry& e )
+{
+	snapshot snap( e.info_fname, m_version );
+	e.header  = snap.m_header;
+	e.ind_min = snap.ind_min;
+	e.ind_max = snap.ind_max;
+
+	e.amr_bytes = e.hydro_bytes = e.part_bytes = 0;
+	std::string outdir = e.info_fname.substr( 0, e.info_fname.find_last_of("/\\") );
+	std::vector<std::string> names;
+	list_directory( outdir, names );
+	for( size_t i=0; i<names.size(); ++i ){
+		//... only the data files XXX_NNNNN.outYYYYY, not caches placed next to them ...//
+		long long size, mtime;
+		size_t pos = names[i].find(".out");
+		if( pos == std::string::npos || pos+4 == names[i].size()
+			|| names[i].find_first_not_of( "0123456789", pos+4 ) != std::string::npos
+			|| !file_stamp( outdir+"/"+names[i], size, mtime ) )
+			continue;
+		if( names[i].compare( 0, 4, "amr_" ) == 0 )
+			e.amr_bytes += size;
+		else if( names[i].compare( 0, 6, "hydro_" ) == 0 )
+			e.hydro_bytes += size;
+		else if( names[i].compare( 0, 5, "part_" ) == 0 )
+			e.part_bytes += size;
+	}
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+inline catalog::catalog( std::string dir, codeversion ver, bool use_index )
+: m_dir( dir ), m_version( ver )
+{
+	std::vector<std::string> names;
+	if( !list_directory( m_dir, names ) )
+		throw std::runtime_error("RAMSES::catalog : cannot list directory \'"+m_dir+"\'.");
+
+	//... all output_XXXXX directories with an info file ...//
+	for( size_t i=0; i<names.size(); ++i ){
+		unsigned nout;
+		if( names[i].size() != 12 || sscanf( names[i].c_str(), "output_%05u", &nout ) != 1 )
+			continue;
+		char info[32];
+		snprintf( info, sizeof(info), "/info_%05u.txt", nout );
+
+		catalog_entry e;
+		e.nout = nout;
+		e.info_fname = m_dir+"/"+names[i]+info;
+		if( file_stamp( e.info_fname, e.info_size, e.info_mtime ) )
+			m_entries.push_back( e );
+	}
+
+	//... reuse unchanged entries from the index file ...//
+	std::map<unsigned,size_t> indexed;
+	std::vector<catalog_entry> old;
+	if( use_index && read_index( default_index_fname(), old ) )
+		for( size_t i=0; i<old.size(); ++i )
+			indexed[ old[i].nout ] = i;
+
+	std::vector<char> parsed( m_entries.size(), 0 ), failed( m_entries.size(), 0 );
+	for( size_t i=0; i<m_entries.size(); ++i ){
+		std::map<unsigned,size_t>::const_iterator it = indexed.find( m_entries[i].nout );
+		if( it != indexed.end() && old[it->second].info_size == m_entries[i].info_size
+			&& old[it->second].info_mtime == m_entries[i].info_mtime ){
+			std::string fname = m_entries[i].info_fname;
+			m_entries[i] = old[it->second];
+			m_entries[i].info_fname = fname;
+		}else
+			parsed[i] = 1;
+	}
+
+	//... parse the remaining info files in parallel ...//
+	long long nentries = (long long)m_entries.size();
+	#pragma omp parallel for schedule(dynamic,1)
+	for( long long i=0; i<nentries; ++i ){
+		if( !parsed[i] )
+			continue;
+		try{
+			parse_entry( m_entries[i] );
+		}catch( std::exception& ){
+			failed[i] = 1;
+		}
+	}
+
+	//... drop unreadable snapshots, e.g. outputs still being written ...//
+	size_t nparsed = 0, j = 0;
+	for( size_t i=0; i<m_entries.size(); ++i ){
+		if( failed[i] ){
+			std::cerr << "RAMSES::catalog : skipping unreadable snapshot \'" << m_entries[i].info_fname << "\'" << std::endl;
+			continue;
+		}
+		nparsed += parsed[i];
+		if( j != i )
+			m_entries[j] = m_entries[i];
+		++j;
+	}
+	m_entries.resize( j );
+
+	struct by_nout{
+		bool operator()( const catalog_entry& a, const catalog_entry& b ) const
+		{ return a.nout < b.nout; }
+	};
+	std::sort( m_entries.begin(), m_entries.end(), by_nout() );
+
+	if( use_index && (nparsed > 0 || m_entries.size() != old.size()) )
+		if( !save_index( default_index_fname() ) )
+			std::cerr << "RAMSES::catalog : unable to write index file \'" << default_index_fname() << "\'" << std::endl;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+inline bool catalog::save_index( const std::string& fname ) const
+{
+	std::ofstream ofs( fname.c_str(), std::ios::binary|std::ios::trunc );
+	if( !ofs.good() )
+		return false;
+
+	index_header hdr;
+	std::memset( &hdr, 0, sizeof(index_header) );
+	std::memcpy( hdr.magic, CATALOG_INDEX_MAGIC, 8 );
+	hdr.version   = CATALOG_INDEX_VERSION;
+	hdr.info_size = sizeof(snapshot::info_data);
+	hdr.nentries  = m_entries.size();
+	ofs.write( (const char*)&hdr, sizeof(index_header) );
+
+	for( size_t i=0; i<m_entries.size(); ++i ){
+		const catalog_entry& e = m_entries[i];
+		unsigned ndomains = e.ind_min.size();
+		ofs.write( (const char*)&e.nout, sizeof(unsigned) );
+		ofs.write( (const char*)&e.info_size, sizeof(long long) );
+		ofs.write( (const char*)&e.info_mtime, sizeof(long long) );
+		ofs.write( (const char*)&e.amr_bytes, sizeof(long long) );
+		ofs.write( (const char*)&e.hydro_bytes, sizeof(long long) );
+		ofs.write( (const char*)&e.part_bytes, sizeof(long long) );
+		ofs.write( (const char*)&e.header, sizeof(snapshot::info_data) );
+		ofs.write( (const char*)&ndomains, sizeof(unsigned) );
+		if( ndomains > 0 ){
+			ofs.write( (const char*)&e.ind_min[0], ndomains*sizeof(double) );
+			ofs.write( (const char*)&e.ind_max[0], ndomains*sizeof(double) );
+		}
+	}
+	return ofs.good();
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+inline bool catalog::read_index( const std::string& fname, std::vector<catalog_entry>& entries )
+{
+	entries.clear();
+	std::ifstream ifs( fname.c_str(), std::ios::binary );
+	if( !ifs.good() )
+		return false;
+
+	index_header hdr;
+	ifs.read( (char*)&hdr, sizeof(index_header) );
+	if( !ifs.good() || std::memcmp( hdr.magic, CATALOG_INDEX_MAGIC, 8 ) != 0
+		|| hdr.version != CATALOG_INDEX_VERSION || hdr.info_size != sizeof(snapshot::info_data) )
+		return false;
+
+	entries.resize( hdr.nentries );
+	for( unsigned i=0; i<hdr.nentries; ++i ){
+		catalog_entry& e = entries[i];
+		unsigned ndomains = 0;
+		ifs.read( (char*)&e.nout, sizeof(unsigned) );
+		ifs.read( (char*)&e.info_size, sizeof(long long) );
+		ifs.read( (char*)&e.info_mtime, sizeof(long long) );
+		ifs.read( (char*)&e.amr_bytes, sizeof(long long) );
+		ifs.read( (char*)&e.hydro_bytes, sizeof(long long) );
+		ifs.read( (char*)&e.part_bytes, sizeof(long long) );
+		ifs.read( (char*)&e.header, sizeof(snapshot::info_data) );
+		ifs.read( (char*)&ndomains, sizeof(unsigned) );
+		if( !ifs.good() || ndomains != e.header.ncpu ){
+			entries.clear();
+			return false;
+		}
+		e.ind_min.resize( ndomains );
+		e.ind_max.resize( ndomains );
+		if( ndomains > 0 ){
+			ifs.read( (char*)&e.ind_min[0], ndomains*sizeof(double) );
+			ifs.read( (char*)&e.ind_max[0], ndomains*sizeof(double) );
+		}
+		if( !ifs.good() ){
+			entries.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace RAMSES
+
+#endif //__RAMSES_CATALOG_HH
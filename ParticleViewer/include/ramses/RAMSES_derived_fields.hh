@@ -0,0 +1,340 @@
+/*
+		This file is part of libRAMSES++
+			a C++ library to access snapshot files
+			generated by the simulation code RAMSES by R. Teyssier
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RAMSES_DERIVED_FIELDS_HH
+#define __RAMSES_DERIVED_FIELDS_HH
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cmath>
+
+#include "RAMSES_info.hh"
+#include "RAMSES_hydro_data.hh"
+
+namespace RAMSES{
+namespace HYDRO{
+
+//! conversion factor from P/rho in code units to T/mu in Kelvin
+/*!
+ * @param snap the snapshot providing the unit system
+ */
+inline double temperature_scale( const RAMSES::snapshot& snap )
+{
+	const double mH = 1.6600000e-24, kB = 1.3806200e-16;
+	double unit_v = snap.m_header.unit_l/snap.m_header.unit_t;
+	return unit_v*unit_v*mH/kB;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+/*!
+ * @class RAMSES::HYDRO::derived_fields
+ * @brief lazily evaluated variables derived from hydro data
+ *
+ * Derived fields are registered as a list of input variables and a batch
+ * kernel. Inputs are either variables read into the slots of a hydro data
+ * object or other derived fields. A field is evaluated level by level only
+ * when it is first accessed; the result is kept in an LRU cache whose total
+ * size is bounded by a memory budget, so no full-mesh copies are needed.
+ * @sa RAMSES::HYDRO::data
+ */
+template< typename TreeType_, typename Real_=double >
+class derived_fields{
+
+public:
+	//! batch kernel computing out[i] for i<n from the input arrays in[k][i]
+	/*! kernels are called concurrently on disjoint chunks and must be thread-safe,
+	 *  plain loops over the raw pointers are auto-vectorized by the compiler.
+	 */
+	typedef std::function< void( const Real_* const* in, Real_* out, size_t n ) > kernel_type;
+
+protected:
+
+	//! a registered field
+	struct field{
+		std::vector<std::string> m_inputs;	//!< names of the input variables
+		kernel_type m_kernel;				//!< the batch kernel
+	};
+
+	//! a cached level of a derived field
+	struct entry{
+		std::string m_name;					//!< name of the field
+		unsigned m_ilevel;					//!< refinement level
+		std::vector<Real_> m_values;		//!< cell-major values
+		int m_pins;							//!< number of evaluations currently using this entry
+	};
+
+	typedef std::list<entry> cache_list;
+	typedef std::pair<std::string,unsigned> cache_key;
+
+	data<TreeType_,Real_>& m_source;		//!< hydro data providing the input variables
+	std::map<std::string,field> m_fields;	//!< registered fields
+	cache_list m_cache;						//!< cached levels, most recently used first
+	std::map< cache_key, typename cache_list::iterator > m_cache_map;	//!< index into the cache
+	size_t m_budget;						//!< memory budget for the cache in bytes
+	size_t m_bytes;							//!< memory currently used by the cache in bytes
+	std::vector<std::string> m_evaluating;	//!< fields currently being evaluated (cycle detection)
+
+	//! number of values per kernel call
+	static const size_t chunk_size = 16384;
+
+	//! get a cached level, evaluating it if necessary
+	typename cache_list::iterator lookup( const std::string& name, unsigned ilevel );
+
+	//! evaluate one level of a field into a new cache entry
+	typename cache_list::iterator evaluate( const std::string& name, unsigned ilevel );
+
+	//! drop least recently used entries until the cache fits into the budget
+	void evict( void );
+
+public:
+
+	//! constructor for a set of derived fields
+	/*!
+	 * @param source hydro data object holding the input variables in its slots
+	 * @param budget memory budget for cached levels in bytes
+	 */
+	explicit derived_fields( data<TreeType_,Real_>& source, size_t budget=((size_t)1)<<30 )
+	: m_source( source ), m_budget( budget ), m_bytes( 0 )
+	{ }
+
+	//! register a derived field, replaces a field of the same name
+	/*!
+	 * @param name the string identifier of the derived field
+	 * @param inputs names of the hydro variables or derived fields passed to the kernel
+	 * @param kernel the batch kernel
+	 */
+	void add( const std::string& name, const std::vector<std::string>& inputs, kernel_type kernel )
+	{
+		field f;
+		f.m_inputs = inputs;
+		f.m_kernel = kernel;
+		m_fields[name] = f;
+		clear_cache();
+	}
+
+	//! register temperature (T/mu, from pressure and density) and velocity_magnitude
+	/*!
+	 * @param temp_scale factor converting P/rho to temperature, e.g. from temperature_scale()
+	 */
+	void add_default_fields( double temp_scale=1.0 )
+	{
+		std::vector<std::string> tin, vin;
+		tin.push_back("density"); tin.push_back("pressure");
+		vin.push_back("velocity_x"); vin.push_back("velocity_y"); vin.push_back("velocity_z");
+
+		Real_ scale = (Real_)temp_scale;
+		add( "temperature", tin, [scale]( const Real_* const* in, Real_* out, size_t n ){
+			const Real_ *rho = in[0], *p = in[1];
+			for( size_t i=0; i<n; ++i )
+				out[i] = scale*p[i]/rho[i];
+		});
+		add( "velocity_magnitude", vin, []( const Real_* const* in, Real_* out, size_t n ){
+			const Real_ *vx = in[0], *vy = in[1], *vz = in[2];
+			for( size_t i=0; i<n; ++i )
+				out[i] = std::sqrt( vx[i]*vx[i]+vy[i]*vy[i]+vz[i]*vz[i] );
+		});
+	}
+
+	//! check whether a derived field of the given name is registered
+	bool has( const std::string& name ) const
+	{ return m_fields.find(name) != m_fields.end(); }
+
+	//! access the values of a derived field on one level
+	/*! the reference stays valid until the next call to level() or cell_value()
+	 * @param name the string identifier of the derived field
+	 * @param ilevel the refinement level
+	 * @return cell-major values of all octs on the level
+	 */
+	const std::vector<Real_>& level( const std::string& name, unsigned ilevel )
+	{ return lookup( name, ilevel )->m_values; }
+
+	//! access the value of a derived field in a single cell
+	/*! for bulk access, level() avoids the cache lookup per cell
+	 * @param name the string identifier of the derived field
+	 * @param it the grid iterator pointing to the current oct
+	 * @param ind index of the child cell of the current oct (0..7)
+	 */
+	Real_ cell_value( const std::string& name, const typename TreeType_::iterator& it, int ind )
+	{
+		unsigned twotondim = 1<<m_source.m_header.ndim;
+		return level( name, it.get_level() )[twotondim*it.get_absolute_position()+ind];
+	}
+
+	//! set the memory budget for cached levels in bytes
+	void set_budget( size_t budget )
+	{
+		m_budget = budget;
+		evict();
+	}
+
+	//! memory currently used by cached levels in bytes
+	size_t bytes_used( void ) const
+	{ return m_bytes; }
+
+	//! drop all cached levels
+	void clear_cache( void )
+	{
+		m_cache.clear();
+		m_cache_map.clear();
+		m_bytes = 0;
+	}
+};
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< typename TreeType_, typename Real_ >
+typename derived_fields<TreeType_,Real_>::cache_list::iterator
+derived_fields<TreeType_,Real_>::lookup( const std::string& name, unsigned ilevel )
+{
+	typename std::map< cache_key, typename cache_list::iterator >::iterator mit = m_cache_map.find( cache_key(name,ilevel) );
+	if( mit != m_cache_map.end() ){
+		//... move to the front of the LRU list ...//
+		m_cache.splice( m_cache.begin(), m_cache, mit->second );
+		return m_cache.begin();
+	}
+
+	typename cache_list::iterator eit = evaluate( name, ilevel );
+	evict();
+	return eit;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< typename TreeType_, typename Real_ >
+typename derived_fields<TreeType_,Real_>::cache_list::iterator
+derived_fields<TreeType_,Real_>::evaluate( const std::string& name, unsigned ilevel )
+{
+	typename std::map<std::string,field>::iterator fit = m_fields.find( name );
+	if( fit == m_fields.end() )
+		throw std::runtime_error("RAMSES::HYDRO::derived_fields : unknown field \'"+name+"\'.");
+
+	if( std::find( m_evaluating.begin(), m_evaluating.end(), name ) != m_evaluating.end() )
+		throw std::runtime_error("RAMSES::HYDRO::derived_fields : cyclic definition of field \'"+name+"\'.");
+
+	const field& f = fit->second;
+	size_t ninputs = f.m_inputs.size();
+	std::vector<const Real_*> in( ninputs, (const Real_*)NULL );
+	std::vector<typename cache_list::iterator> pinned;
+	size_t n = 0;
+
+	m_evaluating.push_back( name );
+	try{
+		//... gather the inputs, derived inputs stay pinned in the cache ...//
+		for( size_t k=0; k<ninputs; ++k ){
+			const std::vector<Real_>* values;
+			if( has( f.m_inputs[k] ) ){
+				typename cache_list::iterator eit = lookup( f.m_inputs[k], ilevel );
+				++eit->m_pins;
+				pinned.push_back( eit );
+				values = &eit->m_values;
+			}else
+				values = &m_source.slot_level( m_source.slot( f.m_inputs[k] ), ilevel );
+
+			if( k > 0 && values->size() != n )
+				throw std::runtime_error("RAMSES::HYDRO::derived_fields : inputs of field \'"+name+"\' differ in size.");
+			n = values->size();
+			in[k] = values->empty()? NULL : &(*values)[0];
+		}
+	}catch(...){
+		for( size_t i=0; i<pinned.size(); ++i )
+			--pinned[i]->m_pins;
+		m_evaluating.pop_back();
+		throw;
+	}
+
+	m_cache.push_front( entry() );
+	typename cache_list::iterator eit = m_cache.begin();
+	eit->m_name   = name;
+	eit->m_ilevel = ilevel;
+	eit->m_pins   = 0;
+	eit->m_values.resize( n );
+	m_cache_map[ cache_key(name,ilevel) ] = eit;
+	m_bytes += n*sizeof(Real_);
+
+	//... evaluate the kernel in parallel on chunks of the level ...//
+	long long nchunks = (long long)((n+chunk_size-1)/chunk_size);
+	bool failed = false;
+	std::string error;
+
+	#pragma omp parallel for schedule(static)
+	for( long long ichunk=0; ichunk<nchunks; ++ichunk ){
+		size_t offset = (size_t)ichunk*chunk_size;
+		size_t count  = std::min( chunk_size, n-offset );
+		std::vector<const Real_*> local( ninputs );
+		for( size_t k=0; k<ninputs; ++k )
+			local[k] = in[k]+offset;
+		try{
+			f.m_kernel( ninputs>0? &local[0] : NULL, &eit->m_values[offset], count );
+		}catch( std::exception& e ){
+			#pragma omp critical (RAMSES_derived_fields)
+			if( !failed ){ failed = true; error = e.what(); }
+		}
+	}
+
+	for( size_t i=0; i<pinned.size(); ++i )
+		--pinned[i]->m_pins;
+	m_evaluating.pop_back();
+
+	if( failed ){
+		m_cache_map.erase( cache_key(name,ilevel) );
+		m_bytes -= n*sizeof(Real_);
+		m_cache.erase( eit );
+		throw std::runtime_error("RAMSES::HYDRO::derived_fields : evaluation of \'"+name+"\' failed: "+error);
+	}
+
+	return eit;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+template< typename TreeType_, typename Real_ >
+void derived_fields<TreeType_,Real_>::evict( void )
+{
+	//... the most recently used entry is always kept ...//
+	typename cache_list::iterator it = m_cache.end();
+	while( m_bytes > m_budget && it != m_cache.begin() ){
+		--it;
+		if( it == m_cache.begin() )
+			break;
+		if( it->m_pins > 0 )
+			continue;
+
+		m_bytes -= it->m_values.size()*sizeof(Real_);
+		m_cache_map.erase( cache_key(it->m_name,it->m_ilevel) );
+		it = m_cache.erase( it );
+	}
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+} // namespace HYDRO
+} // namespace RAMSES
+
+#endif //__RAMSES_DERIVED_FIELDS_HH
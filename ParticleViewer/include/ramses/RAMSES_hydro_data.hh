@@ -26,11 +26,20 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
 
 #include "FortranUnformatted_IO.hh"
+#include "MappedFile_IO.hh"
 #include "RAMSES_info.hh"
 #include "RAMSES_amr_data.hh"
+#include "RAMSES_parallel.hh"
+
+#define HYDRO_BULK_MAGIC   "RAMSESHB"
+#define HYDRO_BULK_VERSION 1
 
 namespace RAMSES{
 namespace HYDRO{
@@ -56,6 +65,30 @@ const char ramses_hydro_variables[][64] = {
 	{"metallicity"} };
 
 
+//! reorder child-major hydro records into the cell-major layout of the level arrays
+/*! src holds twotondim consecutive records of ncache values, one per child cell,
+ *  dst receives ncache*twotondim values with the children of each oct adjacent.
+ *  The octs are processed in blocks so that reads and writes of a block stay in cache.
+ * @param src pointer to the child-major input records
+ * @param ncache number of octs
+ * @param twotondim number of children per oct
+ * @param dst pointer to the cell-major output
+ */
+template< typename ValueType_ >
+inline void transpose_children( const double* src, unsigned ncache, unsigned twotondim, ValueType_* dst )
+{
+	const unsigned block = 256;
+	for( unsigned j0=0; j0<ncache; j0+=block ){
+		unsigned j1 = std::min( ncache, j0+block );
+		for( unsigned i=0; i<twotondim; ++i ){
+			const double* s = src + (size_t)i*ncache;
+			ValueType_* d = dst + i;
+			for( unsigned j=j0; j<j1; ++j )
+				d[(size_t)j*twotondim] = (ValueType_)s[j];
+		}
+	}
+}
+
 /**************************************************************************************\
 \**************************************************************************************/
 
@@ -103,9 +136,21 @@ public:
 	{
 		unsigned ipos   = it.get_absolute_position();
 		unsigned ilevel = it.get_level();//-m_minlevel;
+		//... a level skipped by a partial read is empty ...//
+		assert( ilevel < m_var_array.size() && m_twotondim*ipos+ind < m_var_array[ilevel].size() );
 		return (m_var_array[ilevel])[m_twotondim*ipos+ind];
 	}
 
+	//! access the value of a cell given by a cell reference
+	/*!
+	 * @param c the cell reference, e.g. obtained from one of the tree query functions
+	 */
+	inline ValueType_& cell_value( const RAMSES::AMR::cell_ref& c )
+	{
+		assert( c.m_ilevel < m_var_array.size() && m_twotondim*c.m_igrid+c.m_ind < m_var_array[c.m_ilevel].size() );
+		return (m_var_array[c.m_ilevel])[m_twotondim*c.m_igrid+c.m_ind];
+	}
+
 	//! access the value of the cells associated with the oct designated by the iterator
 	/*!
 	 * @param it the grid iterator pointing to the current oct
@@ -158,6 +203,20 @@ public:
  */
 template< typename TreeType_, typename ValueType_=double >
 class empty_data : public proto_data<TreeType_,ValueType_>{
+
+protected:
+
+	//! header of the bulk binary file, followed by the number of values per level
+	//! and the cell-major values of all levels
+	struct bulk_header{
+		char      magic[8];			//!< file identifier HYDRO_BULK_MAGIC
+		unsigned  version;			//!< format version HYDRO_BULK_VERSION
+		unsigned  value_size;		//!< sizeof(ValueType_) of the writer
+		unsigned  byte_order;		//!< 0x01020304 in the byte order of the writer
+		unsigned  codec;			//!< payload compression, 0 = uncompressed
+		int       cpu;				//!< domain of the tree
+		unsigned  nlevels;			//!< number of levels stored
+	};
 	
 public:
 
@@ -276,6 +335,105 @@ public:
 		}
 	}
 	
+	//! write the variable to a bulk binary file
+	/*! the file holds a header, the number of values per level and the cell-major
+	 *  values of all levels, each level written contiguously in a single write.
+	 *  The file is named after the convention
+	 *  (path)/(basename)_(snap_num).hbin(DOMAIN)
+	 *  and is stored uncompressed in native byte order.
+	 * @param path the path where to store the files
+	 * @param basename the filename base string to prepend to the snapshot number
+	 * @param snap_num the number of the snapshot (default is zero).
+	 */
+	void save_bulk( std::string path, std::string basename, unsigned snap_num=0 )
+	{
+		char fullname[256];
+		snprintf(fullname,sizeof(fullname),"%s/%s_%05d.hbin%05d",path.c_str(),basename.c_str(), snap_num, this->m_tree.m_cpu );
+
+		bulk_header hdr;
+		std::memset( &hdr, 0, sizeof(bulk_header) );
+		std::memcpy( hdr.magic, HYDRO_BULK_MAGIC, 8 );
+		hdr.version    = HYDRO_BULK_VERSION;
+		hdr.value_size = sizeof(ValueType_);
+		hdr.byte_order = 0x01020304;
+		hdr.cpu        = this->m_tree.m_cpu;
+		hdr.nlevels    = this->m_var_array.size();
+
+		std::vector<unsigned long long> level_size;
+		for( unsigned ilvl=0; ilvl<this->m_var_array.size(); ++ilvl )
+			level_size.push_back( this->m_var_array[ilvl].size() );
+
+		std::ofstream ofs( fullname, std::ios::binary|std::ios::trunc );
+		if( !ofs.good() )
+			throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::save_bulk : unable to open file \'")+fullname+"\'");
+
+		ofs.write( (const char*)&hdr, sizeof(bulk_header) );
+		if( !level_size.empty() )
+			ofs.write( (const char*)&level_size[0], level_size.size()*sizeof(unsigned long long) );
+		for( unsigned ilvl=0; ilvl<this->m_var_array.size(); ++ilvl )
+			if( level_size[ilvl] > 0 )
+				ofs.write( (const char*)&this->m_var_array[ilvl][0], level_size[ilvl]*sizeof(ValueType_) );
+
+		if( !ofs.good() )
+			throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::save_bulk : error writing file \'")+fullname+"\'");
+	}
+
+	//! read the variable from a bulk binary file written by save_bulk()
+	/*! the file is memory mapped and each level is copied in parallel chunks.
+	 *  A std::runtime_error is thrown if the file does not match the AMR tree.
+	 * @param basename the base string used for the variable, including the path
+	 */
+	void read_bulk( std::string basename )
+	{
+		char fullname[256];
+		snprintf(fullname,sizeof(fullname),"%s_%05d.hbin%05d",basename.c_str(), this->m_tree.m_header.nout[0], this->m_tree.m_cpu );
+
+		MappedFile mf( fullname );
+		bulk_header hdr;
+		if( mf.size() < sizeof(bulk_header) )
+			throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::read_bulk : truncated file \'")+fullname+"\'");
+		std::memcpy( &hdr, mf.data(), sizeof(bulk_header) );
+
+		if( std::memcmp( hdr.magic, HYDRO_BULK_MAGIC, 8 ) != 0 || hdr.version != HYDRO_BULK_VERSION
+			|| hdr.byte_order != 0x01020304 || hdr.value_size != sizeof(ValueType_) || hdr.codec != 0 )
+			throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::read_bulk : incompatible file \'")+fullname+"\'");
+
+		if( hdr.cpu != this->m_tree.m_cpu || hdr.nlevels != this->m_var_array.size()
+			|| mf.size() < sizeof(bulk_header)+hdr.nlevels*sizeof(unsigned long long) )
+			throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::read_bulk : file \'")+fullname+"\' does not match the AMR tree");
+
+		//... check all level sizes and the total payload before copying ...//
+		std::vector<unsigned long long> level_size( hdr.nlevels );
+		if( hdr.nlevels > 0 )
+			std::memcpy( &level_size[0], mf.data()+sizeof(bulk_header), hdr.nlevels*sizeof(unsigned long long) );
+		size_t payload = 0;
+		for( unsigned ilvl=0; ilvl<hdr.nlevels; ++ilvl ){
+			if( level_size[ilvl] != this->m_var_array[ilvl].size() )
+				throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::read_bulk : dimension mismatch between AMR tree and file \'")+fullname+"\'");
+			payload += level_size[ilvl]*sizeof(ValueType_);
+		}
+		size_t offset = sizeof(bulk_header)+hdr.nlevels*sizeof(unsigned long long);
+		if( mf.size() != offset+payload )
+			throw std::runtime_error(std::string("RAMSES::HYDRO::empty_data::read_bulk : truncated file \'")+fullname+"\'");
+
+		const size_t chunk = 1<<20;
+		for( unsigned ilvl=0; ilvl<hdr.nlevels; ++ilvl ){
+			size_t nbytes = level_size[ilvl]*sizeof(ValueType_);
+			if( nbytes == 0 )
+				continue;
+			char* dst = (char*)&this->m_var_array[ilvl][0];
+			const char* src = mf.data()+offset;
+			long long nchunks = (long long)((nbytes+chunk-1)/chunk);
+
+			#pragma omp parallel for schedule(static)
+			for( long long ic=0; ic<nchunks; ++ic ){
+				size_t first = (size_t)ic*chunk;
+				std::memcpy( dst+first, src+first, std::min( chunk, nbytes-first ) );
+			}
+			offset += nbytes;
+		}
+	}
+
 	//! reads an additional from a RAMSES compatible (single var) output file
 	/*!
 	 * @param basename the base string used for the variable
@@ -343,6 +501,24 @@ public:
 
 protected:
 
+	//! storage for variables read together, the current slot is held in m_var_array
+	std::vector< std::vector< std::vector<Real_> > > m_slots;
+	std::vector<std::string> m_slot_names;	//!< names of the variables held in the slots
+	std::vector<unsigned> m_slot_vars;		//!< file indices of the variables held in the slots
+	unsigned m_current_slot;				//!< index of the slot currently held in m_var_array
+	std::vector<bool> m_level_loaded;		//!< flags the levels of the slots that have been read
+
+	//! file offsets of the per-level blocks, empty until the file has been indexed
+	std::vector<FortranUnformatted::streampos> m_level_offsets;
+
+	//! access the per-level array of a slot regardless of whether it is the current one
+	std::vector< std::vector<Real_> >& slot_array( unsigned islot )
+	{
+		if( islot == m_current_slot )
+			return this->m_var_array;
+		return m_slots[islot];
+	}
+
 	//! generates a hydro_XXXX filename for specified cpu
 	std::string gen_fname( int icpu );
 
@@ -380,6 +556,46 @@ protected:
 	 */
 	void read( unsigned var );
 
+	//! perform a single pass read of several hydro variables (internal use)
+	/*!
+	 * the variables are stored in slots in the order given, the first
+	 * one becomes the current variable
+	 * @param vars the indices of the hydro variables, no duplicates allowed
+	 */
+	void read_vars( const std::vector<unsigned>& vars );
+
+	//! set up empty slots for the given variables (internal use)
+	/*!
+	 * @param vars the indices of the hydro variables, no duplicates allowed
+	 */
+	void init_slots( const std::vector<unsigned>& vars );
+
+	//! read or skip the blocks of one level for the variables held in the slots (internal use)
+	/*!
+	 * @param ff the hydro file, positioned at the start of the level
+	 * @param ilvl the refinement level
+	 * @param store if false the records are skipped
+	 * @param tmp buffer for the raw records
+	 */
+	void read_level( FortranUnformatted& ff, unsigned ilvl, bool store, std::vector<double>& tmp );
+
+	//! scan the file once to record the offsets of the per-level blocks
+	void build_level_index( void );
+
+	//! resolve variable names to file indices, dropping duplicates
+	std::vector<unsigned> get_var_indices( const std::vector<std::string>& varnames, std::vector<std::string>& unique_names )
+	{
+		std::vector<unsigned> vars;
+		unique_names.clear();
+		for( unsigned i=0; i<varnames.size(); ++i ){
+			if( std::find( unique_names.begin(), unique_names.end(), varnames[i] ) != unique_names.end() )
+				continue;
+			vars.push_back( get_var_idx( varnames[i] ) );
+			unique_names.push_back( varnames[i] );
+		}
+		return vars;
+	}
+
 public:
 
 	//! constructor for hydro data
@@ -389,7 +605,7 @@ public:
 	explicit data( TreeType_& AMRtree )
 	: proto_data<TreeType_,Real_>( AMRtree ),
 	  m_fname( rename_amr2hydro(AMRtree.m_fname) ),
-		m_nvars( 6 )
+		m_nvars( 6 ), m_current_slot( 0 )
 	{
 		read_header();
 
@@ -431,6 +647,117 @@ public:
 	void read( std::string varname )
 	{	this->read( get_var_idx( varname ) );  }
 
+	//! read several hydro variables in a single pass through the file
+	/*! the first variable becomes the current one accessed through cell_value(it,ind)
+	 *  and operator(), the others are accessed through slots or made current by select()
+	 * @param varnames the string identifiers of the hydro variables
+	 */
+	void read( const std::vector<std::string>& varnames )
+	{
+		std::vector<unsigned> vars = get_var_indices( varnames, m_slot_names );
+		read_vars( vars );
+	}
+
+	//! read several hydro variables on a range of levels only
+	/*! levels outside the range stay empty until they are requested through load_levels(),
+	 *  levels already loaded for the same set of variables are kept. Each level is read
+	 *  by seeking directly to its block using an index of per-level file offsets.
+	 * @param varnames the string identifiers of the hydro variables
+	 * @param lmin the coarsest level to be read
+	 * @param lmax the finest level to be read
+	 */
+	void read_levels( const std::vector<std::string>& varnames, unsigned lmin, unsigned lmax )
+	{
+		std::vector<std::string> names;
+		std::vector<unsigned> vars = get_var_indices( varnames, names );
+		if( vars != m_slot_vars || m_level_loaded.empty() ){
+			m_slot_names = names;
+			init_slots( vars );
+		}
+		load_levels( lmin, lmax );
+	}
+
+	//! load a range of levels of the variables held in the slots, if not loaded yet
+	/*!
+	 * @param lmin the coarsest level to be loaded
+	 * @param lmax the finest level to be loaded
+	 */
+	void load_levels( unsigned lmin, unsigned lmax );
+
+	//! check whether a level of the variables held in the slots has been read
+	/*!
+	 * @param ilevel the refinement level
+	 */
+	bool is_level_loaded( unsigned ilevel ) const
+	{ return ilevel < m_level_loaded.size() && m_level_loaded[ilevel]; }
+
+	//! get the slot index of a variable read by read( const std::vector<std::string>& )
+	/*!
+	 * @param varname the string identifier of the hydro variable
+	 * @return slot index
+	 */
+	unsigned slot( const std::string& varname ) const
+	{
+		std::vector<std::string>::const_iterator it = std::find( m_slot_names.begin(), m_slot_names.end(), varname );
+		if( it == m_slot_names.end() )
+			throw std::runtime_error("RAMSES::HYDRO::data::slot : variable '"+varname+"' has not been read.");
+		return (unsigned)(it-m_slot_names.begin());
+	}
+
+	//! number of variables held in the slots
+	unsigned num_slots( void ) const
+	{ return (unsigned)m_slots.size(); }
+
+	//! make a previously read variable the current one
+	/*!
+	 * @param varname the string identifier of the hydro variable
+	 */
+	void select( const std::string& varname )
+	{
+		unsigned islot = slot( varname );
+		if( islot == m_current_slot )
+			return;
+		std::swap( this->m_var_array, m_slots[m_current_slot] );
+		std::swap( this->m_var_array, m_slots[islot] );
+		m_current_slot = islot;
+	}
+
+	//! access the values on one level of a variable held in a slot
+	/*!
+	 * @param islot slot index of the variable as returned by slot()
+	 * @param ilevel the refinement level
+	 * @return cell-major values of all octs on the level
+	 */
+	std::vector<Real_>& slot_level( unsigned islot, unsigned ilevel )
+	{
+		return slot_array(islot).at(ilevel);
+	}
+
+	using proto_data<TreeType_,Real_>::cell_value;
+
+	//! access the value of a cell for a variable held in a slot
+	/*!
+	 * @param it the grid iterator pointing to the current oct
+	 * @param ind index of the child cell of the current oct (0..7)
+	 * @param islot slot index of the variable as returned by slot()
+	 */
+	inline Real_& cell_value( const typename TreeType_::iterator& it, int ind, unsigned islot )
+	{
+		assert( is_level_loaded( it.get_level() ) );
+		return slot_array(islot)[it.get_level()][this->m_twotondim*it.get_absolute_position()+ind];
+	}
+
+	//! access the value of a cell given by a cell reference for a variable held in a slot
+	/*!
+	 * @param c the cell reference, e.g. obtained from one of the tree query functions
+	 * @param islot slot index of the variable as returned by slot()
+	 */
+	inline Real_& cell_value( const RAMSES::AMR::cell_ref& c, unsigned islot )
+	{
+		assert( is_level_loaded( c.m_ilevel ) );
+		return slot_array(islot)[c.m_ilevel][this->m_twotondim*c.m_igrid+c.m_ind];
+	}
+
 };
 
 
@@ -452,56 +779,161 @@ void data<TreeType_,Real_>::read_header( void )
 template< typename TreeType_, typename Real_ >
 void data<TreeType_,Real_>::read( unsigned var )
 {
-	this->m_var_array.clear();
-	//int twotondim = (int)(pow(2,m_header.ndim)+0.5);
+	m_slot_names.assign( 1, std::string( var>=1 && var<=m_varnames.size()? m_varnames[var-1] : "" ) );
+	read_vars( std::vector<unsigned>( 1, var ) );
+}
+
+
+template< typename TreeType_, typename Real_ >
+void data<TreeType_,Real_>::init_slots( const std::vector<unsigned>& vars )
+{
+	for( unsigned k=0; k<vars.size(); ++k )
+		if( vars[k] < 1 || vars[k] > m_header.nvar )
+			throw std::runtime_error("RAMSES::HYDRO::data::read : requested variable is invalid in file '"+m_fname+"'.");
+
+	m_slot_vars = vars;
+	m_current_slot = 0;
+	m_slots.assign( vars.size(), std::vector< std::vector<Real_> >( this->m_maxlevel+1 ) );
+	if( !m_slots.empty() )
+		std::swap( this->m_var_array, m_slots[0] );
+	else
+		this->m_var_array.clear();
+	m_level_loaded.assign( this->m_maxlevel+1, false );
+}
+
+
+template< typename TreeType_, typename Real_ >
+void data<TreeType_,Real_>::read_level( FortranUnformatted& ff, unsigned ilvl, bool store, std::vector<double>& tmp )
+{
+	//... visit the variables in file order ...//
+	std::vector< std::pair<unsigned,unsigned> > order;
+	for( unsigned k=0; k<m_slot_vars.size(); ++k )
+		order.push_back( std::make_pair( m_slot_vars[k], k ) );
+	std::sort( order.begin(), order.end() );
+
+	if( store ){
+		for( unsigned k=0; k<m_slot_vars.size(); ++k ){
+			std::vector<Real_>& lvl = slot_array(k)[ilvl];
+			lvl.clear();
+			if( ilvl < this->m_tree.m_AMR_levels.size() )
+				lvl.reserve( (size_t)this->m_tree.m_AMR_levels[ilvl].size()*this->m_twotondim );
+		}
+	}
+
+	for( unsigned icpu = 0; icpu<m_header.ncpu+m_header.nboundary; ++icpu ){
+
+			unsigned file_ilevel, file_ncache;
+			ff.read(file_ilevel);
+			ff.read(file_ncache);
+
+			if( file_ncache == 0 )
+					continue;
+
+		if( store ){
+			if( file_ilevel != ilvl+1 )
+				throw std::runtime_error("RAMSES::HYDRO::data::read : corrupted file " \
+					 "or file seek failure in file '"+m_fname+"'.");
+
+
+			//... records are read as stored, in double precision ...//
+			size_t nrec = (size_t)file_ncache*this->m_twotondim;
+			tmp.resize( m_slot_vars.size()*nrec );
+			for( unsigned i=0; i<this->m_twotondim; ++i )
+			{
+				//... read the requested records, skip runs of the others ...//
+				unsigned inext = 1;
+				for( unsigned k=0; k<order.size(); ++k ){
+					ff.skip_n( order[k].first-inext );
+					ff.read_n( &tmp[order[k].second*nrec+(size_t)i*file_ncache], file_ncache );
+					inext = order[k].first+1;
+				}
+				ff.skip_n( m_header.nvar+1-inext );
+			}
+			//.. reorder array to increase data locality..//
+			for( unsigned k=0; k<m_slot_vars.size(); ++k ){
+				std::vector<Real_>& lvl = slot_array(k)[ilvl];
+				size_t offset = lvl.size();
+				lvl.resize( offset+nrec );
+				transpose_children( &tmp[k*nrec], file_ncache, this->m_twotondim, &lvl[offset] );
+			}
+		}else{
+			ff.skip_n( this->m_twotondim*m_header.nvar );
+		}
+	}
+}
+
+
+template< typename TreeType_, typename Real_ >
+void data<TreeType_,Real_>::read_vars( const std::vector<unsigned>& vars )
+{
+	init_slots( vars );
 
 	FortranUnformatted ff( gen_fname( this->m_cpu ) );
+	std::vector<double> tmp;
+	std::vector<FortranUnformatted::streampos> offsets;
 
 	//.. skip header entries ..//
 	ff.skip_n_from_start( 6 ); //.. skip header
 
-	if( var < 1 || var > m_header.nvar )
-		throw std::runtime_error("RAMSES::HYDRO::data::read : requested variable is invalid in file \'"+m_fname+"\'.");
+	for( unsigned ilvl = 0; ilvl<=this->m_maxlevel; ++ilvl ){
+		offsets.push_back( ff.tellg() );
+		read_level( ff, ilvl, ilvl >= this->m_minlevel, tmp );
+		m_level_loaded[ilvl] = ilvl >= this->m_minlevel;
+	}
 
-	this->m_var_array.clear();
+	//... the sequential pass yields the level index for free ...//
+	if( m_level_offsets.empty() )
+		m_level_offsets.swap( offsets );
+}
 
-	for( unsigned ilvl = 0; ilvl<=this->m_maxlevel; ++ilvl ){
 
-		this->m_var_array.push_back( std::vector<Real_>() );
+template< typename TreeType_, typename Real_ >
+void data<TreeType_,Real_>::build_level_index( void )
+{
+	FortranUnformatted ff( gen_fname( this->m_cpu ) );
+	ff.skip_n_from_start( 6 ); //.. skip header
 
+	m_level_offsets.clear();
+	for( unsigned ilvl = 0; ilvl<=this->m_maxlevel; ++ilvl ){
+		m_level_offsets.push_back( ff.tellg() );
 		for( unsigned icpu = 0; icpu<m_header.ncpu+m_header.nboundary; ++icpu ){
+			unsigned file_ilevel, file_ncache;
+			ff.read(file_ilevel);
+			ff.read(file_ncache);
+			if( file_ncache > 0 )
+				ff.skip_n( this->m_twotondim*m_header.nvar );
+		}
+	}
+}
 
-				unsigned file_ilevel, file_ncache;
-				ff.read(file_ilevel);
-				ff.read(file_ncache);
 
-				if( file_ncache == 0 )
-						continue;
+template< typename TreeType_, typename Real_ >
+void data<TreeType_,Real_>::load_levels( unsigned lmin, unsigned lmax )
+{
+	if( m_level_loaded.empty() )
+		throw std::runtime_error("RAMSES::HYDRO::data::load_levels : no variables selected in file '"+m_fname+"'.");
 
-			if( ilvl >= this->m_minlevel ){
-				if( file_ilevel != ilvl+1 )
-					throw std::runtime_error("RAMSES::HYDRO::data::read : corrupted file " \
-						 "or file seek failure in file \'"+m_fname+"\'.");
+	lmin = std::max( lmin, this->m_minlevel );
+	lmax = std::min( lmax, this->m_maxlevel );
 
+	bool needed = false;
+	for( unsigned ilvl=lmin; ilvl<=lmax; ++ilvl )
+		needed |= !m_level_loaded[ilvl];
+	if( !needed )
+		return;
 
-				std::vector<float> tmp;
-				for( unsigned i=0; i<this->m_twotondim; ++i )
-				{
-					ff.skip_n( var-1 );
-					ff.read<double>( std::back_inserter(tmp) );
-					ff.skip_n( m_header.nvar-var );
-				}
-				//.. reorder array to increase data locality..//
-				this->m_var_array.reserve( tmp.size() );
-				for( unsigned i=0; i<file_ncache; ++i ){
-					for( unsigned j=0; j<this->m_twotondim; ++j ){
-						(this->m_var_array.back()).push_back( tmp[i+j*file_ncache] );
-					}
-				}
-			}else{
-				ff.skip_n( this->m_twotondim*m_header.nvar );
-			}
-		}
+	if( m_level_offsets.empty() )
+		build_level_index();
+
+	FortranUnformatted ff( gen_fname( this->m_cpu ) );
+	std::vector<double> tmp;
+
+	for( unsigned ilvl=lmin; ilvl<=lmax; ++ilvl ){
+		if( m_level_loaded[ilvl] )
+			continue;
+		ff.seekg( m_level_offsets[ilvl] );
+		read_level( ff, ilvl, true, tmp );
+		m_level_loaded[ilvl] = true;
 	}
 }
 
@@ -541,6 +973,108 @@ std::string data<TreeType_,Real_>::rename_amr2hydro( const std::string& info )
 /**************************************************************************************\
 \**************************************************************************************/
 
+namespace detail{
+	template< typename Data_ >
+	inline auto level_loaded( const Data_& var, unsigned ilevel, int ) -> decltype( var.is_level_loaded( ilevel ) )
+	{	return var.is_level_loaded( ilevel );	}
+
+	template< typename Data_ >
+	inline bool level_loaded( const Data_&, unsigned, long )
+	{	return true;	}
+
+	template< typename Data_ >
+	inline auto load_levels( Data_& var, unsigned lmin, unsigned lmax, int ) -> decltype( var.load_levels( lmin, lmax ) )
+	{	var.load_levels( lmin, lmax );	}
+
+	template< typename Data_ >
+	inline void load_levels( Data_&, unsigned, unsigned, long )
+	{	}
+}
+
+//! check whether the cell values of a level can be accessed
+/*! false for levels skipped by data::read_levels(); objects without is_level_loaded(),
+ *  e.g. derived fields, are taken to provide every level
+ * @param var the hydro variable
+ * @param ilevel the refinement level
+ */
+template< typename Data_ >
+inline bool level_loaded( const Data_& var, unsigned ilevel )
+{	return detail::level_loaded( var, ilevel, 0 );	}
+
+//! load the levels a query reaches that have not been read yet
+/*! queries call this once they know which cells they touch and before they access
+ *  the values, so after data::read_levels() on the coarse levels only the finer levels
+ *  that a view or query actually reaches are read. Consecutive levels are loaded in one
+ *  pass. Not thread-safe, call it outside of parallel regions.
+ * @param var the hydro variable, objects without load_levels() are left alone
+ * @param touched flags of the levels reached by the query, indexed by level
+ */
+template< typename Data_ >
+inline void load_touched_levels( Data_& var, const std::vector<char>& touched )
+{
+	unsigned nlevels = (unsigned)touched.size();
+	for( unsigned lmin=0; lmin<nlevels; ++lmin ){
+		if( !touched[lmin] || level_loaded( var, lmin ) )
+			continue;
+		unsigned lmax = lmin;
+		while( lmax+1<nlevels && touched[lmax+1] && !level_loaded( var, lmax+1 ) )
+			++lmax;
+		detail::load_levels( var, lmin, lmax, 0 );
+		lmin = lmax;
+	}
+}
+
+//! sample the variables held in the slots of a hydro data object at arbitrary points
+/*! each point takes the values of the leaf cell containing it (nearest-leaf interpolation).
+ *  The points are located in parallel, Morton-ordered batches by tree::locate_points.
+ *  The levels of the leaves found that have not been read yet are loaded (see
+ *  load_touched_levels()). Points outside the tree or in cells owned by another domain
+ *  are left untouched, so the domains of a multi-domain snapshot can be sampled one
+ *  after the other.
+ * @param tree the AMR tree, must be built with son links (cell_locally_essential)
+ * @param hydro the hydro data, with the variables to sample read into its slots
+ * @param x pointer to n x-coordinates
+ * @param y pointer to n y-coordinates
+ * @param z pointer to n z-coordinates
+ * @param n number of points
+ * @param out point-major output of n*hydro.num_slots() values, out[i*nslots+islot]
+ * @return number of points that were sampled
+ */
+template< typename TreeType_, typename Real_, typename PosType_, typename ValueType_ >
+size_t sample_points( const TreeType_& tree, data<TreeType_,Real_>& hydro,
+					  const PosType_* x, const PosType_* y, const PosType_* z, size_t n, ValueType_* out )
+{
+	std::vector<RAMSES::AMR::cell_ref> cells;
+	tree.locate_points( x, y, z, n, cells );
+
+	unsigned nslots = hydro.num_slots();
+	long long np = (long long)n, nfound = 0;
+
+	//... read the levels of the owned leaves the points fall in ...//
+	std::vector<char> touched( tree.m_AMR_levels.size(), 0 );
+	for( size_t i=0; i<n; ++i )
+		if( cells[i].m_igrid != ENDPOINT
+			&& tree.m_AMR_levels[cells[i].m_ilevel].m_level_cells[cells[i].m_igrid].m_cpu == (unsigned)tree.m_cpu )
+			touched[cells[i].m_ilevel] = 1;
+	load_touched_levels( hydro, touched );
+
+	#pragma omp parallel for schedule(static) reduction(+:nfound)
+	for( long long i=0; i<np; ++i ){
+		const RAMSES::AMR::cell_ref& c = cells[i];
+		if( c.m_igrid == ENDPOINT
+			|| tree.m_AMR_levels[c.m_ilevel].m_level_cells[c.m_igrid].m_cpu != (unsigned)tree.m_cpu
+			|| !hydro.is_level_loaded( c.m_ilevel ) )
+			continue;
+		for( unsigned islot=0; islot<nslots; ++islot )
+			out[(size_t)i*nslots+islot] = (ValueType_)hydro.cell_value( c, islot );
+		++nfound;
+	}
+	return (size_t)nfound;
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
 
 /*! 
  * @class RAMSES::HYDRO::multi_domain_data
@@ -559,6 +1093,7 @@ class multi_domain_data
 		RAMSES::snapshot &m_rsnap;			//!< reference to the underlying snapshot object
 		std::vector<DataType_*> m_data;		//!< vector of bundled data objects
 		std::vector<TreeType_*> m_ptrees;	//!< vector of bundled tree objects
+		int m_max_open;						//!< maximum number of domains read concurrently
 		
 	public:
 	
@@ -568,12 +1103,16 @@ class multi_domain_data
 		 * @param ptrees vector of trees to be bundled
 		 */
 		multi_domain_data( RAMSES::snapshot& rsnap, std::vector<TreeType_*> ptrees )
-		: m_ndomains( ptrees.size() ), m_rsnap(rsnap), m_ptrees( ptrees )
+		: m_ndomains( ptrees.size() ), m_rsnap(rsnap), m_ptrees( ptrees ), m_max_open( RAMSES_MAX_OPEN_FILES )
 		{ 
 			for( unsigned idom=0; idom<m_ndomains; ++idom )
 				m_data.push_back( new DataType_(*m_ptrees[idom]) );
 			
 		}
+
+		//! set the maximum number of domains read concurrently, 1 reads serially
+		void set_max_open( int max_open )
+		{ m_max_open = std::max( 1, max_open ); }
 		
 		
 		//! combines all elements of this instance with that of another using a binary operator
@@ -641,11 +1180,25 @@ class multi_domain_data
 				return;
 			}
 			
-			for( unsigned idom=0; idom<m_ndomains; ++idom )
-			{
-				//m_data.push_back( new DataType_(*m_ptrees[idom]) );
-				m_data[idom]->read(var_name);
+			for_each_domain( m_ndomains, [&]( unsigned idom ){ m_data[idom]->read(var_name); }, m_max_open );
+		}
+
+		//! bundled single pass read of several variables, reads in multi-domain data
+		void get_var( const std::vector<std::string>& var_names )
+		{
+			if( m_ndomains != m_data.size() ){
+				std::cerr << "Error: Internal consistency check failed in multi_domain_data::get_var.";
+				return;
 			}
+
+			for_each_domain( m_ndomains, [&]( unsigned idom ){ m_data[idom]->read(var_names); }, m_max_open );
+		}
+
+		//! make a previously read variable the current one in all domains
+		void select( const std::string& var_name )
+		{
+			for( unsigned idom=0; idom<m_data.size(); ++idom )
+				m_data[idom]->select(var_name);
 		}
 
 		//! TBD
@@ -28,6 +28,7 @@
 #include <fstream>
 #include <stdexcept>
 #include <cmath>
+#include <mutex>
 
 namespace RAMSES{
 
@@ -55,6 +56,153 @@ const int state_diagram[12][2][8] =
 };
 	
     
+//! state_diagram fused into one byte per entry, (next state << 3) | hilbert digit
+const unsigned char hilbert_table[12][8] =
+{
+	{   8,  17,  27,  18,  39,  46,  28,  45 },
+	{  16,  55,   1,  62,  67,  68,   2,  61 },
+	{   0,  75,  87,  76,   9,  10,  94,  93 },
+	{  50,   3,  49,  88,  77,   4,  78,  71 },
+	{  92,  91,   5,  58,  47,  72,   6,  57 },
+	{  38,  37,  65,  66,   7,  52,  80,  51 },
+	{  44,  63,  43,  24,  13,  14,  90,  89 },
+	{  54,  15,  53,  84,  73,  32,  74,  83 },
+	{  82,  29,  11,  12,  81,  30,  40,  79 },
+	{  34,  33,  69,  70,  19,  56,  20,  31 },
+	{  60,  21,  95,  22,  59,  42,  64,  41 },
+	{  86,  25,  23,  48,  85,  26,  36,  35 }
+};
+
+//! inverse of hilbert_table, (next state << 3) | octant index for each hilbert digit
+const unsigned char hilbert_inverse_table[12][8] =
+{
+	{   8,  17,  19,  26,  30,  47,  45,  36 },
+	{  16,   2,   6,  68,  69,  63,  59,  49 },
+	{   0,  12,  13,  73,  75,  95,  94,  82 },
+	{  91,  50,  48,   1,   5,  76,  78,  71 },
+	{  77,  63,  59,  89,  88,   2,   6,  44 },
+	{  86,  66,  67,  55,  53,  33,  32,   4 },
+	{  27,  95,  94,  42,  40,  12,  13,  57 },
+	{  37,  76,  78,  87,  83,  50,  48,   9 },
+	{  46,  84,  80,  10,  11,  25,  29,  79 },
+	{  61,  33,  32,  20,  22,  66,  67,  31 },
+	{  70,  47,  45,  60,  56,  17,  19,  90 },
+	{  51,  25,  29,  39,  38,  84,  80,  18 }
+};
+
+//! maximum number of bits per coordinate for which hilbert keys fit into 64 bits
+const unsigned hilbert_max_bits = 21;
+
+//! compute the hilbert key of one point with integer coordinates
+/*! processes one refinement level, i.e. 3 bits, per step through hilbert_table
+ *  without any heap allocation.
+ * @param x the integer x-coordinate, only the lowest bit_length bits are used
+ * @param y the integer y-coordinate, only the lowest bit_length bits are used
+ * @param z the integer z-coordinate, only the lowest bit_length bits are used
+ * @param bit_length number of bits per coordinate, at most hilbert_max_bits
+ * @return the hilbert key, 3*bit_length bits wide
+ */
+inline unsigned long long hilbert3d_key( unsigned x, unsigned y, unsigned z, unsigned bit_length )
+{
+	unsigned long long key = 0;
+	unsigned state = 0;
+	for( int i=(int)bit_length-1; i>=0; --i ){
+		unsigned sdigit = (((x>>i)&1u)<<2) | (((y>>i)&1u)<<1) | ((z>>i)&1u);
+		unsigned entry  = hilbert_table[state][sdigit];
+		key   = (key<<3) | (entry&7u);
+		state = entry>>3;
+	}
+	return key;
+}
+
+//! compute the hilbert keys of many points with integer coordinates
+/*! the loop over points has no dependencies and is split among threads for
+ *  large batches.
+ * @param npoints number of points
+ * @param x pointer to npoints integer x-coordinates
+ * @param y pointer to npoints integer y-coordinates
+ * @param z pointer to npoints integer z-coordinates
+ * @param keys pointer to npoints keys on return
+ * @param bit_length number of bits per coordinate, at most hilbert_max_bits
+ */
+inline void hilbert3d_keys( size_t npoints, const int* x, const int* y, const int* z,
+						   unsigned long long* keys, unsigned bit_length )
+{
+	if( bit_length > hilbert_max_bits )
+		throw std::runtime_error("RAMSES::hilbert3d_keys : bit_length exceeds 64 bit keys.");
+
+	long long np = (long long)npoints;
+	#pragma omp parallel for schedule(static) if( np > 65536 )
+	for( long long ip=0; ip<np; ++ip )
+		keys[ip] = hilbert3d_key( (unsigned)x[ip], (unsigned)y[ip], (unsigned)z[ip], bit_length );
+}
+
+//! compute the integer coordinates of a point from its hilbert key
+/*! inverse of hilbert3d_key(), processes 3 bits per step through hilbert_inverse_table
+ * @param key the hilbert key, 3*bit_length bits wide
+ * @param bit_length number of bits per coordinate, at most hilbert_max_bits
+ * @param x the integer x-coordinate on return
+ * @param y the integer y-coordinate on return
+ * @param z the integer z-coordinate on return
+ */
+inline void hilbert3d_decode( unsigned long long key, unsigned bit_length, unsigned& x, unsigned& y, unsigned& z )
+{
+	unsigned state = 0;
+	x = y = z = 0;
+	for( int i=(int)bit_length-1; i>=0; --i ){
+		unsigned entry  = hilbert_inverse_table[state][(key>>(3*i))&7u];
+		x |= ((entry>>2)&1u)<<i;
+		y |= ((entry>>1)&1u)<<i;
+		z |= (entry&1u)<<i;
+		state = entry>>3;
+	}
+}
+
+//! a cube of the octree whose cells form one contiguous interval of hilbert keys
+struct hilbert_cube{
+	unsigned level;		//!< refinement level of the cube, its side length is 2^-level
+	unsigned x, y, z;	//!< integer coordinates of the cube on its level
+};
+
+//! decompose an interval of hilbert keys into the fewest aligned octree cubes
+/*! every aligned block of 8^k keys is the set of cells of one cube of the octree,
+ *  so the interval is covered exactly by at most 14 cubes per level.
+ * @param kmin first key of the interval
+ * @param kmax one past the last key of the interval
+ * @param bit_length number of bits per coordinate of the keys, at most hilbert_max_bits
+ * @param cubes the covering cubes are appended, in hilbert order
+ */
+inline void hilbert3d_cover( unsigned long long kmin, unsigned long long kmax, unsigned bit_length,
+							 std::vector<hilbert_cube>& cubes )
+{
+	unsigned long long k = kmin;
+	while( k < kmax ){
+		//... largest aligned block starting at k that fits into the interval ...//
+		unsigned lev = 0;
+		while( lev < bit_length ){
+			unsigned long long block = 1ull<<(3*(lev+1));
+			if( (k & (block-1)) != 0 || kmax-k < block )
+				break;
+			++lev;
+		}
+		hilbert_cube c;
+		c.level = bit_length-lev;
+		hilbert3d_decode( k>>(3*lev), c.level, c.x, c.y, c.z );
+		cubes.push_back( c );
+		k += 1ull<<(3*lev);
+	}
+}
+
+//! compute the hilbert ordering of many points as floating point numbers
+/*! kept for compatibility, the keys are computed by hilbert3d_keys() and are
+ *  exact as long as they fit into the mantissa of a double (bit_length<=17).
+ * @param npoints number of points
+ * @param x pointer to npoints integer x-coordinates
+ * @param y pointer to npoints integer y-coordinates
+ * @param z pointer to npoints integer z-coordinates
+ * @param order pointer to npoints hilbert keys on return
+ * @param bit_length number of bits per coordinate
+ */
 inline void hilbert3d(
                       unsigned npoints,
                       const int* x,
@@ -63,72 +211,11 @@ inline void hilbert3d(
                       double* order,
                       unsigned bit_length )
 {
-    std::vector<bool> i_bit_mask(3*bit_length, false );
-    std::vector<bool> x_bit_mask(1*bit_length, false );
-    std::vector<bool> y_bit_mask(1*bit_length, false );
-    std::vector<bool> z_bit_mask(1*bit_length, false );
-    
-    //unsigned npoints = x.size();
-    //double lx = pow(2.0,bit_length);
-    
-    for( unsigned ip=0; ip<npoints; ++ip )
-    {
-        for( unsigned i=0; i<bit_length; ++i )
-        {
-            /*int xx = (int)(x[ip]*lx);
-            x_bit_mask[i] = btest(xx,i);
-            
-            xx = (int)(y[ip]*lx);
-            y_bit_mask[i] = btest(xx,i);
-            
-            xx = (int)(z[ip]*lx);
-            z_bit_mask[i] = btest(xx,i);*/
-            
-            x_bit_mask[i] = btest(x[ip],i);
-            y_bit_mask[i] = btest(y[ip],i);
-            z_bit_mask[i] = btest(z[ip],i);
-            //std::cerr << x[ip] << " " << y[ip] << " " << z[ip] << std::endl;
-            //std::cerr << i << ": " << x_bit_mask[i] << " " << y_bit_mask[i] << " " << z_bit_mask[i] << std::endl;
-            
-        }
-        
-        for( unsigned i=0; i<bit_length; ++i )
-        {
-            i_bit_mask[3*i+2] = x_bit_mask[i];
-            i_bit_mask[3*i+1] = y_bit_mask[i];
-            i_bit_mask[3*i+0] = z_bit_mask[i];
-        }
-        
-        int nstate, cstate;
-        bool b0, b1, b2;
-        int sdigit, hdigit;
-        
-        cstate=0;
-        for( int i=bit_length-1; i>=0; --i )
-        {
-            b2 = i_bit_mask[3*i+2];
-            b1 = i_bit_mask[3*i+1];
-            b0 = i_bit_mask[3*i+0];
-            
-            sdigit = b2*4+b1*2+b0;
-            nstate = state_diagram[cstate][0][sdigit];
-            hdigit = state_diagram[cstate][1][sdigit];
-            
-            i_bit_mask[3*i+2] = btest(hdigit,2);
-            i_bit_mask[3*i+1] = btest(hdigit,1);
-            i_bit_mask[3*i+0] = btest(hdigit,0);
-            
-            cstate = nstate;
-        }
-        
-        order[ip] = 0.0;
-        for( unsigned i=0; i<3*bit_length; ++i )
-        {
-            b0 = i_bit_mask[i];
-            order[ip] += (double)(b0*(1<<i));
-        }
-        
-    }	
+	if( bit_length > hilbert_max_bits )
+		throw std::runtime_error("RAMSES::hilbert3d : bit_length exceeds 64 bit keys.");
+
+	for( unsigned ip=0; ip<npoints; ++ip )
+		order[ip] = (double)hilbert3d_key( (unsigned)x[ip], (unsigned)y[ip], (unsigned)z[ip], bit_length );
 }
 
 /**************************************************************************************\
@@ -184,6 +271,15 @@ public:
 	std::vector<double> ind_max;
 	
 protected:
+
+	//! octree cubes exactly covering each domain, filled by compute_domain_cover()
+	std::vector< std::vector<hilbert_cube> > m_domain_cubes;
+
+	//! bounding box of each domain, lower corner followed by upper corner
+	std::vector<double> m_domain_bbox;
+
+	//! guards the one-time computation of m_domain_cubes and m_domain_bbox
+	std::once_flag m_domain_cover_once;
 	
 	//! tokenize a string 
 	/*!
@@ -319,6 +415,18 @@ public:
 		parse_file();
 	}
 
+	//! constructor for a snapshot meta data object from already parsed meta data
+	/*! used e.g. by RAMSES::catalog to open a snapshot without reading its info file again
+	 * @param info_filename path and name of the info_XXXXX.txt file of the RAMSES simulation
+	 * @param header the header data of the info file
+	 * @param imin minimum hilbert ordering indices for each domain
+	 * @param imax maximum hilbert ordering indices for each domain
+	 */
+	snapshot( std::string info_filename, const info_data& header, const std::vector<double>& imin,
+			  const std::vector<double>& imax, codeversion ver=RAMSES::version1 )
+	 : m_filename( info_filename ), m_version( ver ), m_header( header ), ind_min( imin ), ind_max( imax )
+	{ }
+
   
 	
 
@@ -332,103 +440,237 @@ public:
 	
 	unsigned getdomain_bykey( double key )
 	{
-		unsigned i = locate( key, ind_min );
+		//... last domain whose range starts at or before key ...//
+		std::vector<double>::const_iterator it = std::upper_bound( ind_min.begin(), ind_min.end(), key );
+		unsigned i = it == ind_min.begin()? 0 : (unsigned)(it-ind_min.begin())-1;
 		return i+1;
 	}
+
+	//! number of bits per coordinate of the integer domain keys
+	/*! levelmax+1, limited to hilbert_max_bits so that the keys fit into 64 bits
+	 */
+	unsigned domain_key_bits( void ) const
+	{
+		return std::min( m_header.levelmax+1, hilbert_max_bits );
+	}
+
+	//! get the hilbert key interval of a domain at domain_key_bits() resolution
+	/*! for levelmax+1 > hilbert_max_bits the keys are coarsened by 8^(levelmax+1-hilbert_max_bits),
+	 *  rounding ind_min down and ind_max up, so a coarse cell straddling a domain
+	 *  boundary belongs to both domains. Both bounds stay sorted across domains.
+	 * @param idomain the domain, starting at 1
+	 * @param kmin first key of the interval on return
+	 * @param kmax one past the last key of the interval on return
+	 * @return false if the domain is empty
+	 */
+	bool get_domain_keys( unsigned idomain, unsigned long long& kmin, unsigned long long& kmax ) const
+	{
+		double dmin = ind_min.at( idomain-1 ), dmax = ind_max.at( idomain-1 );
+		int coarsen = 3*(int)(m_header.levelmax+1-domain_key_bits());
+		if( coarsen == 0 ){
+			kmin = (unsigned long long)(dmin+0.5);
+			kmax = (unsigned long long)(dmax+0.5);
+		}else{
+			kmin = (unsigned long long)std::floor( ldexp( dmin, -coarsen ) );
+			kmax = (unsigned long long)std::ceil( ldexp( dmax, -coarsen ) );
+		}
+		return dmin < dmax;
+	}
+
+	//! compute the cubes covering each domain and their bounding boxes
+	/*! the hilbert key interval of each domain from get_domain_keys() is
+	 *  decomposed into aligned octree cubes with hilbert3d_cover(). Computed once,
+	 *  on first use of the domain bounds and safe to trigger from several threads,
+	 *  so no domain file has to be opened to decide whether it is needed.
+	 */
+	void compute_domain_cover( void )
+	{
+		std::call_once( m_domain_cover_once, &snapshot::build_domain_cover, this );
+	}
+
+protected:
+
+	//! worker of compute_domain_cover(), runs exactly once
+	void build_domain_cover( void )
+	{
+		unsigned bit_length = domain_key_bits();
+
+		m_domain_cubes.assign( m_header.ncpu, std::vector<hilbert_cube>() );
+		m_domain_bbox.assign( 6*m_header.ncpu, 0.0 );
+
+		long long ndomains = (long long)m_header.ncpu;
+		#pragma omp parallel for schedule(dynamic,16)
+		for( long long i=0; i<ndomains; ++i ){
+			unsigned long long kmin, kmax;
+			if( get_domain_keys( (unsigned)i+1, kmin, kmax ) )
+				hilbert3d_cover( kmin, kmax, bit_length, m_domain_cubes[i] );
+
+			//... an empty domain keeps an inverted box that intersects nothing ...//
+			double* bbox = &m_domain_bbox[6*i];
+			bbox[0] = bbox[1] = bbox[2] = 1.0;
+			bbox[3] = bbox[4] = bbox[5] = 0.0;
+			for( size_t j=0; j<m_domain_cubes[i].size(); ++j ){
+				const hilbert_cube& c = m_domain_cubes[i][j];
+				double dx = ldexp( 1.0, -(int)c.level );
+				unsigned ic[3] = { c.x, c.y, c.z };
+				for( int k=0; k<3; ++k ){
+					bbox[k]   = std::min( bbox[k], ic[k]*dx );
+					bbox[k+3] = std::max( bbox[k+3], (ic[k]+1)*dx );
+				}
+			}
+		}
+	}
+
+public:
+
+	//! get the octree cubes covering a domain
+	/*! exact up to levelmax+1 = hilbert_max_bits, beyond that at coarsened key resolution
+	 * @param idomain the domain, starting at 1
+	 * @return the covering cubes in hilbert order
+	 */
+	const std::vector<hilbert_cube>& get_domain_cubes( unsigned idomain )
+	{
+		compute_domain_cover();
+		return m_domain_cubes.at( idomain-1 );
+	}
+
+	//! get the bounding box of a domain in box units [0,1]
+	/*!
+	 * @param idomain the domain, starting at 1
+	 * @param xmin pointer to the 3 coordinates of the lower corner on return
+	 * @param xmax pointer to the 3 coordinates of the upper corner on return
+	 */
+	void get_domain_bounds( unsigned idomain, double* xmin, double* xmax )
+	{
+		compute_domain_cover();
+		const double* bbox = &m_domain_bbox.at( 6*(idomain-1) );
+		for( int k=0; k<3; ++k ){
+			xmin[k] = bbox[k];
+			xmax[k] = bbox[k+3];
+		}
+	}
+
+	//! check whether a domain overlaps an axis-aligned box
+	/*! tests the bounding box first and then the individual covering cubes
+	 * @param idomain the domain, starting at 1
+	 * @param xmin pointer to the 3 coordinates of the lower corner of the box
+	 * @param xmax pointer to the 3 coordinates of the upper corner of the box
+	 */
+	bool domain_intersects_box( unsigned idomain, const double* xmin, const double* xmax )
+	{
+		double bmin[3], bmax[3];
+		get_domain_bounds( idomain, bmin, bmax );
+		for( int k=0; k<3; ++k )
+			if( bmin[k] >= xmax[k] || bmax[k] <= xmin[k] )
+				return false;
+
+		const std::vector<hilbert_cube>& cubes = m_domain_cubes[idomain-1];
+		for( size_t j=0; j<cubes.size(); ++j ){
+			double dx = ldexp( 1.0, -(int)cubes[j].level );
+			if( cubes[j].x*dx < xmax[0] && (cubes[j].x+1)*dx > xmin[0]
+				&& cubes[j].y*dx < xmax[1] && (cubes[j].y+1)*dx > xmin[1]
+				&& cubes[j].z*dx < xmax[2] && (cubes[j].z+1)*dx > xmin[2] )
+				return true;
+		}
+		return false;
+	}
     
-    void get_cpu_list( double *xmin, double *xmax, std::vector<int>& domains )
-    {
-        domains.clear();
-        
-        int idom[8], jdom[8], kdom[8];
-        double bounding_min[8], bounding_max[8];
-        
-        std::vector<bool> cpu_read( m_header.ncpu, false );
-        
-        double dmax = std::max( std::max(xmax[0]-xmin[0],xmax[1]-xmin[1]), xmax[2]-xmin[2]);
-        double dx;
-        unsigned ilevel;
-        for( ilevel=1; ilevel<=m_header.levelmax; ++ilevel )
-        {
-            dx = pow(0.5,ilevel);
-            if( dx < dmax ) break;
-        }
-        
-        int levelmin = ilevel;
-        int bit_length = levelmin-1;
-        int max_domain = 1<<bit_length;
-        
-        size_t imin=0, imax=0, jmin=0, jmax=0, kmin=0, kmax=0;
-        
-        if( bit_length > 0 )
-        {
-            imin = (size_t)(xmin[0]*(double)max_domain);
-            imax = imin+1;
-            jmin = (size_t)(xmin[1]*(double)max_domain);
-            jmax = jmin+1;
-            kmin = (size_t)(xmin[2]*(double)max_domain);
-            kmax = kmin+1;
-        }
-        
-        //std::cerr << "-xmi " << xmin[0] << " -xma " << xmax[0]
-        //<< " -ymi " << xmin[1] << " -yma " << xmax[1]
-        //<< " -zmi " << xmin[2] << " -zma " << xmax[2] << std::endl;
-        
-        double dkey = pow((double)(1<<(m_header.levelmax+1))/(double)max_domain,3);
-        
-        int ndom = 1;
-        if(bit_length>0)ndom=8;
-        idom[0]=imin; idom[1]=imax;
-        idom[2]=imin; idom[3]=imax;
-        idom[4]=imin; idom[5]=imax;
-        idom[6]=imin; idom[7]=imax;
-        
-        jdom[0]=jmin; jdom[1]=jmin;
-        jdom[2]=jmax; jdom[3]=jmax;
-        jdom[4]=jmin; jdom[5]=jmin;
-        jdom[6]=jmax; jdom[7]=jmax;
-        
-        kdom[0]=kmin; kdom[1]=kmin;
-        kdom[2]=kmin; kdom[3]=kmin;
-        kdom[4]=kmax; kdom[5]=kmax;
-        kdom[6]=kmax; kdom[7]=kmax;
-        
-        double order_min = 0.0;
-        
-        for( int i=0; i<ndom; ++i )
-        {
-            if( bit_length>0 )
-                hilbert3d( 1, &idom[i], &jdom[i], &kdom[i], &order_min, bit_length );
-            else
-                order_min = 0.0;
-            bounding_min[i] = order_min*dkey;
-            bounding_max[i] = (order_min+1.0)*dkey;
-        }
-        
-        int cpu_min[8] = {0,0,0,0,0,0,0,0}, cpu_max[8] = {0,0,0,0,0,0,0,0};
-        
-        for( unsigned impi=0; impi<m_header.ncpu; ++impi )
-        {
-            for( int i=0; i<ndom; ++i )
-            {
-                if( ind_min[impi] <= bounding_min[i] &&
-                   ind_max[impi] > bounding_min[i] )
-                    cpu_min[i] = impi;
-                if( ind_min[impi] < bounding_max[i] &&
-                   ind_max[impi] >= bounding_max[i] )
-                    cpu_max[i] = impi;
-            }
-        }
-        
-        for( int i=0; i<ndom; ++i )
-            for( int j=cpu_min[i]; j<=cpu_max[i]; ++j )
-                if( !cpu_read[j] )
-                {
-                    domains.push_back( j+1 );
-                    cpu_read[j] = true;
-                }
-    }
+	//! get the list of domains overlapping an axis-aligned box
+	/*! the box is covered by octree cells on multiple levels, refined level by level
+	 *  only where they cut the box boundary. Cells inside the box become hilbert key
+	 *  intervals that select all domains they overlap; cells still cut by the boundary
+	 *  when refinement stops (at the domain key resolution, or once the number of
+	 *  boundary cells exceeds a budget) select a domain only if one of its covering
+	 *  cubes overlaps the box. The result is the minimal set of domains, sorted.
+	 *  Beyond 21 bits per coordinate the domain keys are coarsened, see get_domain_keys(),
+	 *  and a domain is also selected for a coarse cell it shares with a neighbour.
+	 * @param xmin pointer to the 3 coordinates of the lower corner of the box in [0,1]
+	 * @param xmax pointer to the 3 coordinates of the upper corner of the box in [0,1]
+	 * @param domains the overlapping domains, starting at 1, on return
+	 */
+	void get_cpu_list( double *xmin, double *xmax, std::vector<int>& domains )
+	{
+		domains.clear();
 
+		unsigned bit_length = domain_key_bits();
+
+		//... octree cells cutting the box boundary, refined breadth first ...//
+		struct node{
+			unsigned long long key;
+			unsigned x, y, z, state;
+		};
+		const size_t max_boundary_cells = 1<<15;
+
+		std::vector< std::pair<unsigned long long,unsigned long long> > inside, boundary;
+		std::vector<node> current( 1 ), next;
+		current[0].key = 0;
+		current[0].x = current[0].y = current[0].z = current[0].state = 0;
+
+		for( unsigned ilevel=0; ilevel<=bit_length && !current.empty(); ++ilevel ){
+			double dx = ldexp( 1.0, -(int)ilevel );
+			unsigned shift = 3*(bit_length-ilevel);
+			bool refine = ilevel < bit_length && 8*current.size() <= max_boundary_cells;
+
+			next.clear();
+			for( size_t i=0; i<current.size(); ++i ){
+				const node& n = current[i];
+				double lo[3] = { n.x*dx, n.y*dx, n.z*dx };
+				bool disjoint = false, contained = true;
+				for( int k=0; k<3; ++k ){
+					disjoint  |= lo[k] >= xmax[k] || lo[k]+dx <= xmin[k];
+					contained &= lo[k] >= xmin[k] && lo[k]+dx <= xmax[k];
+				}
+				if( disjoint )
+					continue;
+
+				std::pair<unsigned long long,unsigned long long> range( n.key<<shift, (n.key+1)<<shift );
+				if( contained || ilevel == bit_length )
+					inside.push_back( range );
+				else if( !refine )
+					boundary.push_back( range );
+				else
+					for( unsigned sdigit=0; sdigit<8; ++sdigit ){
+						unsigned entry = hilbert_table[n.state][sdigit];
+						node c;
+						c.key   = (n.key<<3) | (entry&7u);
+						c.x     = 2*n.x + ((sdigit>>2)&1u);
+						c.y     = 2*n.y + ((sdigit>>1)&1u);
+						c.z     = 2*n.z + (sdigit&1u);
+						c.state = entry>>3;
+						next.push_back( c );
+					}
+			}
+			current.swap( next );
+		}
+
+		//... sweep the key intervals against the sorted domain key ranges ...//
+		std::vector<unsigned long long> kmin( m_header.ncpu ), kmax( m_header.ncpu );
+		std::vector<char> empty( m_header.ncpu, 0 );
+		for( unsigned i=0; i<m_header.ncpu; ++i )
+			empty[i] = !get_domain_keys( i+1, kmin[i], kmax[i] );
+
+		std::vector<char> selected( m_header.ncpu, 0 ), tested( m_header.ncpu, 0 );
+		for( int pass=0; pass<2; ++pass ){
+			const std::vector< std::pair<unsigned long long,unsigned long long> >& ranges = pass==0? inside : boundary;
+			for( size_t i=0; i<ranges.size(); ++i ){
+				unsigned idom = std::upper_bound( kmax.begin(), kmax.end(), ranges[i].first )-kmax.begin();
+				for( ; idom<m_header.ncpu && kmin[idom] < ranges[i].second; ++idom ){
+					if( selected[idom] || empty[idom] || (pass==1 && tested[idom]) )
+						continue;
+					if( pass==0 )
+						selected[idom] = 1;
+					else{
+						tested[idom] = 1;
+						selected[idom] = domain_intersects_box( idom+1, xmin, xmax );
+					}
+				}
+			}
+		}
+
+		for( unsigned i=0; i<m_header.ncpu; ++i )
+			if( selected[i] )
+				domains.push_back( i+1 );
+	}
 
 };
 
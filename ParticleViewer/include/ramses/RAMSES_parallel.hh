@@ -0,0 +1,76 @@
+/*
+		This file is part of libRAMSES++
+			a C++ library to access snapshot files
+			generated by the simulation code RAMSES by R. Teyssier
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RAMSES_PARALLEL_HH
+#define __RAMSES_PARALLEL_HH
+
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//! default upper bound on the number of domain files read concurrently
+#ifndef RAMSES_MAX_OPEN_FILES
+#define RAMSES_MAX_OPEN_FILES 8
+#endif
+
+namespace RAMSES{
+
+//! execute a task for every domain of a bundle, in parallel if OpenMP is available
+/*! the tasks are distributed over the OpenMP thread pool, at most max_open of them
+ *  run at the same time, which bounds the number of simultaneously open files when
+ *  each task reads one domain. The first exception thrown by a task is rethrown as
+ *  a std::runtime_error after all tasks have finished.
+ * @param ndomains number of domains, the task is called with indices 0..ndomains-1
+ * @param task functor task( unsigned idomain )
+ * @param max_open maximum number of concurrently running tasks
+ */
+template< typename Task_ >
+void for_each_domain( unsigned ndomains, Task_ task, int max_open=RAMSES_MAX_OPEN_FILES )
+{
+	std::string error;
+	bool failed = false;
+	int ndom = (int)ndomains;
+
+#ifdef _OPENMP
+	int nthreads = std::max( 1, std::min( std::min( max_open, omp_get_max_threads() ), ndom ) );
+	#pragma omp parallel for schedule(dynamic,1) num_threads(nthreads)
+#endif
+	for( int idom=0; idom<ndom; ++idom ){
+		try{
+			task( (unsigned)idom );
+		}catch( std::exception& e ){
+			#pragma omp critical (RAMSES_for_each_domain)
+			if( !failed ){ failed = true; error = e.what(); }
+		}catch( ... ){
+			#pragma omp critical (RAMSES_for_each_domain)
+			if( !failed ){ failed = true; error = "unknown exception"; }
+		}
+	}
+
+	if( failed )
+		throw std::runtime_error("RAMSES::for_each_domain : "+error);
+}
+
+} // namespace RAMSES
+
+#endif //__RAMSES_PARALLEL_HH
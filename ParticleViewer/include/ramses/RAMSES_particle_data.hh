@@ -29,10 +29,12 @@
 #include <algorithm>
 #include <cmath>
 #include <map>
+#include <cstring>
 
 #include "RAMSES_info.hh"
 #include "FortranUnformatted_IO.hh"
 #include "data_iterators.hh"
+#include "RAMSES_parallel.hh"
 
 namespace RAMSES{
 namespace PART{
@@ -330,9 +332,43 @@ public:
 	
 	  return val;
 	}
-	
-	
-	
+
+
+	//! retrieve the particle IDs
+	/*! RAMSES stores IDs as 4 byte integers, or 8 byte integers when compiled with
+	 *  -DLONGINT, the width is deduced from the record size.
+	 * @param val output iterator to which the IDs are sent as long long
+	 * @return final position of the output iterator
+	 */
+	template< typename _OutputIterator >
+	_OutputIterator get_ids( _OutputIterator val )
+	{
+		std::vector<char> raw;
+		get_var<char>( "particle_ID", std::back_inserter(raw) );
+
+		size_t n = (size_t)m_header.npart;
+		if( n == 0 )
+			return val;
+
+		if( raw.size() == n*sizeof(int) ){
+			for( size_t i=0; i<n; ++i ){
+				int id;
+				memcpy( &id, &raw[i*sizeof(int)], sizeof(int) );
+				*val = (long long)id; ++val;
+			}
+		}else if( raw.size() == n*sizeof(long long) ){
+			for( size_t i=0; i<n; ++i ){
+				long long id;
+				memcpy( &id, &raw[i*sizeof(long long)], sizeof(long long) );
+				*val = id; ++val;
+			}
+		}else
+			throw std::runtime_error("RAMSES::PART::data::get_ids : unexpected size of the particle_ID record.");
+
+		return val;
+	}
+
+
 	//=== the following member functions are simply copied from the skeleton ===//
 	
 		
@@ -525,6 +561,7 @@ class multi_domain_data
 		RAMSES::snapshot &m_rsnap;						//!< reference to the underlying snapshot object
 		std::vector< std::vector<ValueType_> > m_data;	//!< vector of bundled data objects
 		std::vector<TreeType_*> m_ptrees;				//!< vector of bundled tree objects
+		int m_max_open;									//!< maximum number of domains read concurrently
 		
 	public:
 	
@@ -534,9 +571,13 @@ class multi_domain_data
 		 * @param ptrees vector of trees to be bundled
 		 */
 		multi_domain_data( RAMSES::snapshot& rsnap, std::vector<TreeType_*> ptrees )
-		: m_ndomains( ptrees.size() ), m_rsnap(rsnap), m_ptrees( ptrees )
+		: m_ndomains( ptrees.size() ), m_rsnap(rsnap), m_ptrees( ptrees ), m_max_open( RAMSES_MAX_OPEN_FILES )
 		{ }
 		
+		//! set the maximum number of domains read concurrently, 1 reads serially
+		void set_max_open( int max_open )
+		{ m_max_open = std::max( 1, max_open ); }
+		
 		
 		//! access a particle in a specific domain
 		/*!
@@ -560,13 +601,11 @@ class multi_domain_data
 		//! bundled read functions, reads in multi-domain data
 		void get_var( std::string var_name )
 		{
-			m_data.clear();
-			for( unsigned idom=0; idom<m_ndomains; ++idom )
-			{
+			m_data.assign( m_ndomains, std::vector<ValueType_>() );
+			for_each_domain( m_ndomains, [&]( unsigned idom ){
 				data local_data( m_rsnap, m_ptrees[idom]->m_cpu );
-				m_data.push_back( std::vector<ValueType_>() );
-				local_data.get_var<ValueType_>(var_name, std::back_inserter(m_data.back()) );
-			}
+				local_data.template get_var<ValueType_>(var_name, std::back_inserter(m_data[idom]) );
+			}, m_max_open );
 		}
 		
 		//! get the pointer to the vector of particles of a specific domain
@@ -0,0 +1,280 @@
+/*
+		This file is part of libRAMSES++
+			a C++ library to access snapshot files
+			generated by the simulation code RAMSES by R. Teyssier
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RAMSES_PARTICLE_INDEX_HH
+#define __RAMSES_PARTICLE_INDEX_HH
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "RAMSES_info.hh"
+#include "RAMSES_particle_data.hh"
+#include "RAMSES_parallel.hh"
+
+namespace RAMSES{
+namespace PART{
+
+typedef long long id_type;
+
+//! read the IDs of all particles of a snapshot, concatenated in domain order
+/*! the position of a particle in the result is its position in any per-snapshot
+ *  store that concatenates the domains in the same order.
+ * @param snap the snapshot
+ * @param ids the IDs, replaced
+ * @param domain_offsets if not null, receives ncpu+1 offsets of the domains in ids
+ */
+inline void read_ids( const snapshot& snap, std::vector<id_type>& ids, std::vector<size_t>* domain_offsets=NULL )
+{
+	unsigned ncpu = snap.m_header.ncpu;
+	std::vector< std::vector<id_type> > domain_ids( ncpu );
+
+	for_each_domain( ncpu, [&]( unsigned idom ){
+		data local_data( snap, idom+1 );
+		local_data.get_ids( std::back_inserter(domain_ids[idom]) );
+	});
+
+	std::vector<size_t> offsets( ncpu+1, 0 );
+	for( unsigned idom=0; idom<ncpu; ++idom )
+		offsets[idom+1] = offsets[idom] + domain_ids[idom].size();
+
+	ids.resize( offsets[ncpu] );
+	for( unsigned idom=0; idom<ncpu; ++idom ){
+		std::copy( domain_ids[idom].begin(), domain_ids[idom].end(), ids.begin()+offsets[idom] );
+		std::vector<id_type>().swap( domain_ids[idom] );
+	}
+
+	if( domain_offsets )
+		domain_offsets->swap( offsets );
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+//! sort particle IDs with a parallel least significant digit radix sort
+/*! the sort is stable, particles with equal IDs keep their relative order. The IDs
+ *  are sorted relative to the smallest one, only the bytes that differ within the
+ *  range of IDs are processed, so 32 bit IDs take at most four passes. Each pass
+ *  counts the digits of contiguous chunks per thread, and every thread then
+ *  scatters its chunk to the offsets of its digits.
+ * @param ids the IDs, sorted on return
+ * @param order receives the original position of each sorted ID
+ */
+inline void radix_sort_ids( std::vector<id_type>& ids, std::vector<size_t>& order )
+{
+	const int nbuckets = 256;
+	size_t n = ids.size();
+	order.resize( n );
+	if( n == 0 )
+		return;
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	if( n > 65536 )
+		nthreads = omp_get_max_threads();
+#endif
+	std::vector<size_t> chunk( nthreads+1 );
+	for( int t=0; t<=nthreads; ++t )
+		chunk[t] = n*t/nthreads;
+
+	//... range of the IDs, the keys are the offsets from the smallest one ...//
+	id_type idmin = ids[0], idmax = ids[0];
+	for( size_t i=1; i<n; ++i ){
+		idmin = std::min( idmin, ids[i] );
+		idmax = std::max( idmax, ids[i] );
+	}
+	unsigned long long range = (unsigned long long)idmax - (unsigned long long)idmin;
+
+	std::vector<unsigned long long> keys( n ), keys_tmp( n );
+	std::vector<size_t> order_tmp( n );
+	#pragma omp parallel for schedule(static) num_threads(nthreads)
+	for( int t=0; t<nthreads; ++t )
+		for( size_t i=chunk[t]; i<chunk[t+1]; ++i ){
+			keys[i] = (unsigned long long)ids[i] - (unsigned long long)idmin;
+			order[i] = i;
+		}
+
+	std::vector<size_t> count( (size_t)nthreads*nbuckets );
+	for( int shift=0; shift<64 && (range>>shift)!=0; shift+=8 )
+	{
+		std::fill( count.begin(), count.end(), 0 );
+
+		#pragma omp parallel for schedule(static) num_threads(nthreads)
+		for( int t=0; t<nthreads; ++t ){
+			size_t* c = &count[(size_t)t*nbuckets];
+			for( size_t i=chunk[t]; i<chunk[t+1]; ++i )
+				++c[(keys[i]>>shift)&0xff];
+		}
+
+		//... a digit shared by all keys leaves the order unchanged ...//
+		bool trivial = false;
+		for( int d=0; d<nbuckets && !trivial; ++d ){
+			size_t total = 0;
+			for( int t=0; t<nthreads; ++t )
+				total += count[(size_t)t*nbuckets+d];
+			trivial = total == n;
+		}
+		if( trivial )
+			continue;
+
+		//... exclusive prefix sum in (digit, thread) order keeps the sort stable ...//
+		size_t offset = 0;
+		for( int d=0; d<nbuckets; ++d )
+			for( int t=0; t<nthreads; ++t ){
+				size_t c = count[(size_t)t*nbuckets+d];
+				count[(size_t)t*nbuckets+d] = offset;
+				offset += c;
+			}
+
+		#pragma omp parallel for schedule(static) num_threads(nthreads)
+		for( int t=0; t<nthreads; ++t ){
+			size_t* c = &count[(size_t)t*nbuckets];
+			for( size_t i=chunk[t]; i<chunk[t+1]; ++i ){
+				size_t j = c[(keys[i]>>shift)&0xff]++;
+				keys_tmp[j] = keys[i];
+				order_tmp[j] = order[i];
+			}
+		}
+		keys.swap( keys_tmp );
+		order.swap( order_tmp );
+	}
+
+	#pragma omp parallel for schedule(static) num_threads(nthreads)
+	for( int t=0; t<nthreads; ++t )
+		for( size_t i=chunk[t]; i<chunk[t+1]; ++i )
+			ids[i] = (id_type)(keys[i] + (unsigned long long)idmin);
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+/*!
+ * @class RAMSES::PART::id_index
+ * @brief maps particle IDs to the position of the particles in a store
+ *
+ * The store is any per-snapshot array of particles, e.g. the concatenation of the
+ * domains returned by read_ids(). The index holds the IDs in ascending order together
+ * with their positions, 16 bytes per particle.
+ */
+class id_index{
+protected:
+	std::vector<id_type> m_ids;		//!< particle IDs in ascending order
+	std::vector<size_t> m_pos;		//!< position in the store of the particle with ID m_ids[i]
+
+public:
+	//! returned by find() for IDs that are not in the index
+	static const size_t npos = (size_t)-1;
+
+	//! construct an empty index
+	id_index( void )
+	{ }
+
+	//! construct the index of a store
+	/*!
+	 * @param ids the IDs of the particles in store order
+	 */
+	explicit id_index( const std::vector<id_type>& ids )
+	{ build( ids ); }
+
+	//! build the index of a store
+	/*!
+	 * @param ids the IDs of the particles in store order
+	 */
+	void build( const std::vector<id_type>& ids )
+	{
+		m_ids = ids;
+		radix_sort_ids( m_ids, m_pos );
+	}
+
+	//! the number of indexed particles
+	size_t size( void ) const
+	{ return m_ids.size(); }
+
+	//! the i-th smallest ID
+	id_type id( size_t i ) const
+	{ return m_ids[i]; }
+
+	//! the store position of the particle with the i-th smallest ID
+	size_t position( size_t i ) const
+	{ return m_pos[i]; }
+
+	//! the store position of the first particle with a given ID, or npos
+	size_t find( id_type id ) const
+	{
+		std::vector<id_type>::const_iterator it = std::lower_bound( m_ids.begin(), m_ids.end(), id );
+		if( it == m_ids.end() || *it != id )
+			return npos;
+		return m_pos[it-m_ids.begin()];
+	}
+};
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+//! pair up the particles of two snapshots by ID
+/*! a merge of the two sorted indices, linear in the number of particles. The matches
+ *  are streamed to a callback in ascending ID order and are not stored, so arbitrarily
+ *  large snapshots can be joined without memory beyond the two indices. If an ID occurs
+ *  several times, its occurrences are paired in store order.
+ * @param a the index of the first snapshot
+ * @param b the index of the second snapshot
+ * @param match functor match( size_t pos_a, size_t pos_b ) called for every pair
+ * @return the number of pairs
+ */
+template< typename Match_ >
+size_t join( const id_index& a, const id_index& b, Match_ match )
+{
+	size_t ia = 0, ib = 0, npairs = 0;
+	while( ia < a.size() && ib < b.size() ){
+		id_type ida = a.id(ia), idb = b.id(ib);
+		if( ida < idb )
+			++ia;
+		else if( idb < ida )
+			++ib;
+		else{
+			match( a.position(ia), b.position(ib) );
+			++ia; ++ib; ++npairs;
+		}
+	}
+	return npairs;
+}
+
+//! pair up the particles of two snapshots by ID
+/*!
+ * @param a the index of the first snapshot
+ * @param b the index of the second snapshot
+ * @param pairs receives the store positions (pos_a, pos_b) of the matched particles
+ * @return the number of pairs
+ */
+inline size_t join( const id_index& a, const id_index& b, std::vector< std::pair<size_t,size_t> >& pairs )
+{
+	pairs.clear();
+	pairs.reserve( std::min( a.size(), b.size() ) );
+	return join( a, b, [&]( size_t pa, size_t pb ){ pairs.push_back( std::make_pair( pa, pb ) ); } );
+}
+
+}// namespace PART
+}// namespace RAMSES
+
+#endif //__RAMSES_PARTICLE_INDEX_HH
@@ -0,0 +1,333 @@
+/*
+		This file is part of libRAMSES++
+			a C++ library to access snapshot files
+			generated by the simulation code RAMSES by R. Teyssier
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RAMSES_PROJECTION_HH
+#define __RAMSES_PROJECTION_HH
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "RAMSES_amr_data.hh"
+#include "RAMSES_hydro_data.hh"
+#include "RAMSES_slice.hh"
+
+namespace RAMSES{
+namespace HYDRO{
+
+//! deposit a uniform square footprint onto a tile with exact pixel overlap weights
+/*!
+ * @param buf row-major tile buffer of nx*ny pixels
+ * @param nx tile width in pixels
+ * @param ny tile height in pixels
+ * @param x0 left edge of the footprint in tile pixel coordinates
+ * @param x1 right edge of the footprint in tile pixel coordinates
+ * @param y0 top edge of the footprint in tile pixel coordinates
+ * @param y1 bottom edge of the footprint in tile pixel coordinates
+ * @param sigma value per unit pixel area
+ */
+inline void deposit_square( double* buf, int nx, int ny, double x0, double x1, double y0, double y1, double sigma )
+{
+	int ix0 = std::max( 0, (int)std::floor(x0) ), ix1 = std::min( nx-1, (int)std::floor(x1) );
+	int iy0 = std::max( 0, (int)std::floor(y0) ), iy1 = std::min( ny-1, (int)std::floor(y1) );
+	for( int iy=iy0; iy<=iy1; ++iy ){
+		double wy = std::min( y1, iy+1.0 ) - std::max( y0, (double)iy );
+		if( wy <= 0.0 )
+			continue;
+		double* row = buf + (size_t)iy*nx;
+		for( int ix=ix0; ix<=ix1; ++ix ){
+			double wx = std::min( x1, ix+1.0 ) - std::max( x0, (double)ix );
+			if( wx > 0.0 )
+				row[ix] += sigma*wx*wy;
+		}
+	}
+}
+
+//! clip a convex polygon against the half plane coord[k] >= bound (or <= bound)
+/*! one step of Sutherland-Hodgman clipping, adds at most one vertex
+ * @return the number of vertices of the clipped polygon in xo, yo
+ */
+inline int clip_polygon( const double* xi, const double* yi, int n, double* xo, double* yo,
+						 int k, double bound, bool above )
+{
+	int m = 0;
+	for( int i=0; i<n; ++i ){
+		int j = (i+1)%n;
+		double ci = k==0? xi[i] : yi[i], cj = k==0? xi[j] : yi[j];
+		bool ini = above? ci >= bound : ci <= bound;
+		bool inj = above? cj >= bound : cj <= bound;
+		if( ini ){
+			xo[m] = xi[i]; yo[m] = yi[i]; ++m;
+		}
+		if( ini != inj ){
+			double t = (bound-ci)/(cj-ci);
+			xo[m] = xi[i]+t*(xi[j]-xi[i]);
+			yo[m] = yi[i]+t*(yi[j]-yi[i]);
+			++m;
+		}
+	}
+	return m;
+}
+
+//! deposit a uniform convex quadrilateral footprint onto a tile with exact pixel overlap weights
+/*! each pixel of the bounding box receives sigma times the area of the quadrilateral
+ *  clipped to the pixel
+ * @param buf row-major tile buffer of nx*ny pixels
+ * @param nx tile width in pixels
+ * @param ny tile height in pixels
+ * @param qx the 4 x-coordinates of the corners in tile pixel coordinates, in order along the outline
+ * @param qy the 4 y-coordinates of the corners in tile pixel coordinates
+ * @param sigma value per unit pixel area
+ */
+inline void deposit_quad( double* buf, int nx, int ny, const double* qx, const double* qy, double sigma )
+{
+	double xmin = std::min( std::min(qx[0],qx[1]), std::min(qx[2],qx[3]) );
+	double xmax = std::max( std::max(qx[0],qx[1]), std::max(qx[2],qx[3]) );
+	double ymin = std::min( std::min(qy[0],qy[1]), std::min(qy[2],qy[3]) );
+	double ymax = std::max( std::max(qy[0],qy[1]), std::max(qy[2],qy[3]) );
+	int ix0 = std::max( 0, (int)std::floor(xmin) ), ix1 = std::min( nx-1, (int)std::floor(xmax) );
+	int iy0 = std::max( 0, (int)std::floor(ymin) ), iy1 = std::min( ny-1, (int)std::floor(ymax) );
+
+	double ax[8], ay[8], bx[8], by[8];
+	for( int iy=iy0; iy<=iy1; ++iy ){
+		double* row = buf + (size_t)iy*nx;
+		for( int ix=ix0; ix<=ix1; ++ix ){
+			int n = clip_polygon( qx, qy, 4, ax, ay, 0, (double)ix, true );
+			n = clip_polygon( ax, ay, n, bx, by, 0, ix+1.0, false );
+			n = clip_polygon( bx, by, n, ax, ay, 1, (double)iy, true );
+			n = clip_polygon( ax, ay, n, bx, by, 1, iy+1.0, false );
+			double area = 0.0;
+			for( int i=0; i<n; ++i ){
+				int j = (i+1)%n;
+				area += bx[i]*by[j]-bx[j]*by[i];
+			}
+			if( n >= 3 )
+				row[ix] += sigma*0.5*std::fabs(area);
+		}
+	}
+}
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+//! project a hydro variable through the AMR mesh onto a pixel grid
+/*! the projection direction is the normal of the plane section (u x v). Each owned leaf
+ *  cell within depth of the plane deposits value*volume onto the pixels it covers, with
+ *  weights given by the exact overlap of its footprint with each pixel, so the result
+ *  is the column integral per unit area (e.g. column density for the gas density).
+ *  Along a coordinate axis the footprint is the cell face, rotated with the image axes
+ *  if u and v are not coordinate axes themselves, and the path length is clipped
+ *  exactly to the slab; for other directions the cell is represented by the square of
+ *  equal projected area centered on its projected center.
+ *
+ *  The image is processed in tiles of at most tile*tile pixels. For every tile, the
+ *  overlapping cells are found by a hierarchical tree query and deposited in parallel
+ *  into per-thread tile buffers, which are then reduced into the image.
+ *  Contributions are added to the image so several domains can be accumulated.
+ *  The levels of the cells found that have not been read yet are loaded before they
+ *  are deposited (see load_touched_levels()).
+ * @param tree the AMR tree, must be built with son links (cell_locally_essential)
+ * @param var the hydro variable, any object providing cell_value( const cell_ref& )
+ * @param pl the plane section defining the image, its normal is the line of sight
+ * @param depth half thickness of the projected slab along the line of sight
+ * @param nx number of pixels along the image x-axis
+ * @param ny number of pixels along the image y-axis
+ * @param image row-major nx*ny image, zero initialized if its size differs
+ * @param tile maximum tile side length in pixels
+ */
+template< typename TreeType_, typename Data_, typename ValueType_ >
+void project( TreeType_& tree, Data_& var, const plane& pl, double depth, unsigned nx, unsigned ny,
+			  std::vector<ValueType_>& image, unsigned tile=1024 )
+{
+	typedef RAMSES::AMR::vec<double> vec_t;
+
+	if( image.size() != (size_t)nx*ny )
+		image.assign( (size_t)nx*ny, ValueType_(0) );
+	if( nx == 0 || ny == 0 )
+		return;
+	tile = std::max( 1u, tile );
+
+	//... image frame: unit vectors, pixel scales and line of sight ...//
+	double lu = std::sqrt( pl.m_u[0]*pl.m_u[0]+pl.m_u[1]*pl.m_u[1]+pl.m_u[2]*pl.m_u[2] );
+	double lv = std::sqrt( pl.m_v[0]*pl.m_v[0]+pl.m_v[1]*pl.m_v[1]+pl.m_v[2]*pl.m_v[2] );
+	if( lu <= 0.0 || lv <= 0.0 )
+		throw std::runtime_error("RAMSES::HYDRO::project : degenerate plane.");
+
+	double eu[3], ev[3], ew[3];
+	for( int k=0; k<3; ++k ){
+		eu[k] = pl.m_u[k]/lu;
+		ev[k] = pl.m_v[k]/lv;
+	}
+	ew[0] = eu[1]*ev[2]-eu[2]*ev[1];
+	ew[1] = eu[2]*ev[0]-eu[0]*ev[2];
+	ew[2] = eu[0]*ev[1]-eu[1]*ev[0];
+	double lw = std::sqrt( ew[0]*ew[0]+ew[1]*ew[1]+ew[2]*ew[2] );
+	for( int k=0; k<3; ++k )
+		ew[k] /= lw;
+
+	double px_u = 2.0*lu/nx, px_v = 2.0*lv/ny;		//!< pixel size in box units
+	int axis = -1;
+	bool aligned_u = false, aligned_v = false;
+	for( int k=0; k<3; ++k ){
+		if( std::fabs(ew[k]) > 1.0-1e-12 )
+			axis = k;
+		aligned_u |= std::fabs(eu[k]) > 1.0-1e-12;
+		aligned_v |= std::fabs(ev[k]) > 1.0-1e-12;
+	}
+	//... the cell face is a pixel-aligned square only if u and v are coordinate axes too ...//
+	bool aligned = aligned_u && aligned_v;
+	//... along an axis, pixel offsets of the two face edges of a unit cell ...//
+	double edge[2][2] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+	if( axis >= 0 )
+		for( int e=0; e<2; ++e ){
+			int k = (axis+1+e)%3;
+			edge[e][0] = eu[k]/px_u;
+			edge[e][1] = -ev[k]/px_v;
+		}
+	double area_factor = std::sqrt( std::fabs(ew[0])+std::fabs(ew[1])+std::fabs(ew[2]) );
+
+	//... image coordinates (pixels, row 0 at the top) and depth of a point ...//
+	struct frame{
+		double c[3], eu[3], ev[3], ew[3], lu, lv, px_u, px_v;
+		void map( const double x[3], double& ix, double& iy, double& iz ) const
+		{
+			double d[3] = { x[0]-c[0], x[1]-c[1], x[2]-c[2] };
+			ix = (d[0]*eu[0]+d[1]*eu[1]+d[2]*eu[2]+lu)/px_u;
+			iy = (lv-(d[0]*ev[0]+d[1]*ev[1]+d[2]*ev[2]))/px_v;
+			iz = d[0]*ew[0]+d[1]*ew[1]+d[2]*ew[2];
+		}
+	} fr;
+	for( int k=0; k<3; ++k ){
+		fr.c[k] = pl.m_center[k]; fr.eu[k] = eu[k]; fr.ev[k] = ev[k]; fr.ew[k] = ew[k];
+	}
+	fr.lu = lu; fr.lv = lv; fr.px_u = px_u; fr.px_v = px_v;
+
+	unsigned ntx = (nx+tile-1)/tile, nty = (ny+tile-1)/tile;
+	std::vector<RAMSES::AMR::cell_ref> cells;
+	std::vector<char> touched( tree.m_AMR_levels.size(), 0 );
+
+	for( unsigned ty=0; ty<nty; ++ty )
+		for( unsigned tx=0; tx<ntx; ++tx ){
+			int tx0 = tx*tile, ty0 = ty*tile;
+			int tw = std::min( tile, nx-tx0 ), th = std::min( tile, ny-ty0 );
+
+			//... leaf cells whose bounding sphere reaches the slab and the tile ...//
+			cells.clear();
+			tree.template query_leaf_cells<double>( [&]( const vec_t& xg, double dx2 ){
+				double x[3] = { xg.x, xg.y, xg.z }, ix, iy, iz;
+				fr.map( x, ix, iy, iz );
+				double r = dx2*1.7320508075688772;
+				return std::fabs(iz) <= depth+r
+					&& ix+r/px_u >= tx0 && ix-r/px_u <= tx0+tw
+					&& iy+r/px_v >= ty0 && iy-r/px_v <= ty0+th;
+			}, cells );
+
+			std::fill( touched.begin(), touched.end(), 0 );
+			for( size_t ic=0; ic<cells.size(); ++ic )
+				touched[cells[ic].m_ilevel] = 1;
+			load_touched_levels( var, touched );
+
+			std::vector<double> sum( (size_t)tw*th, 0.0 );
+			long long ncells = (long long)cells.size();
+
+			#pragma omp parallel
+			{
+				std::vector<double> buf( (size_t)tw*th, 0.0 );
+
+				#pragma omp for schedule(static)
+				for( long long ic=0; ic<ncells; ++ic ){
+					const RAMSES::AMR::cell_ref& c = cells[ic];
+					if( !level_loaded( var, c.m_ilevel ) )
+						continue;
+					RAMSES::AMR::vec<double> xc = tree.template cell_pos<double>( c );
+					double x[3] = { xc.x, xc.y, xc.z }, ix, iy, iz;
+					fr.map( x, ix, iy, iz );
+
+					double side = ldexp( 1.0, -(int)c.m_ilevel-1 );
+					double value = (double)var.cell_value( c );
+					double len;
+					if( axis >= 0 ){
+						//... exact: path length clipped to the slab ...//
+						len = std::min( iz+0.5*side, depth ) - std::max( iz-0.5*side, -depth );
+						if( len <= 0.0 )
+							continue;
+					}else{
+						if( std::fabs(iz) > depth )
+							continue;
+						len = side;
+					}
+					//... per unit pixel area, the overlap weights are in pixel units ...//
+					if( axis >= 0 && !aligned ){
+						//... exact: the rotated cell face ...//
+						double qx[4], qy[4];
+						for( int q=0; q<4; ++q ){
+							double a = (q==1 || q==2)? 0.5*side : -0.5*side, b = q>=2? 0.5*side : -0.5*side;
+							qx[q] = ix-tx0 + a*edge[0][0] + b*edge[1][0];
+							qy[q] = iy-ty0 + a*edge[0][1] + b*edge[1][1];
+						}
+						deposit_quad( &buf[0], tw, th, qx, qy, value*len );
+						continue;
+					}
+					//... the cell itself, or the square of equal projected area ...//
+					double s = axis >= 0? side : side*area_factor;
+					double sigma = value*len*side*side/(s*s);
+					double half  = 0.5*s;
+					deposit_square( &buf[0], tw, th,
+						ix-half/px_u-tx0, ix+half/px_u-tx0, iy-half/px_v-ty0, iy+half/px_v-ty0, sigma );
+				}
+
+				#pragma omp critical (RAMSES_project)
+				for( size_t i=0; i<buf.size(); ++i )
+					sum[i] += buf[i];
+			}
+
+			for( int j=0; j<th; ++j ){
+				ValueType_* out = &image[(size_t)(ty0+j)*nx+tx0];
+				const double* in = &sum[(size_t)j*tw];
+				for( int i=0; i<tw; ++i )
+					out[i] += (ValueType_)in[i];
+			}
+		}
+}
+
+//! project a bundled multi-domain hydro variable onto a pixel grid
+/*!
+ * @param md the bundled hydro data, one tree per domain
+ * @param pl the plane section defining the image, its normal is the line of sight
+ * @param depth half thickness of the projected slab along the line of sight
+ * @param nx number of pixels along the image x-axis
+ * @param ny number of pixels along the image y-axis
+ * @param image row-major nx*ny image, zero initialized if its size differs
+ * @param tile maximum tile side length in pixels
+ */
+template< typename TreeType_, typename DataType_, typename ValueType_ >
+void project( multi_domain_data<TreeType_,DataType_,ValueType_>& md, const plane& pl, double depth,
+			  unsigned nx, unsigned ny, std::vector<ValueType_>& image, unsigned tile=1024 )
+{
+	if( image.size() != (size_t)nx*ny )
+		image.assign( (size_t)nx*ny, ValueType_(0) );
+	for( unsigned idom=0; idom<md.m_data.size(); ++idom )
+		project( *md.m_ptrees[idom], *md.m_data[idom], pl, depth, nx, ny, image, tile );
+}
+
+} // namespace HYDRO
+} // namespace RAMSES
+
+#endif //__RAMSES_PROJECTION_HH
@@ -0,0 +1,194 @@
+/*
+		This file is part of libRAMSES++
+			a C++ library to access snapshot files
+			generated by the simulation code RAMSES by R. Teyssier
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RAMSES_SLICE_HH
+#define __RAMSES_SLICE_HH
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "RAMSES_amr_data.hh"
+#include "RAMSES_hydro_data.hh"
+
+namespace RAMSES{
+namespace HYDRO{
+
+//! a rectangular section of a plane in box units
+struct plane{
+	double m_center[3];		//!< center of the rectangle
+	double m_u[3];			//!< vector from the center to the middle of the right edge (image x)
+	double m_v[3];			//!< vector from the center to the middle of the top edge (image y)
+
+	//! constructor for an arbitrarily oriented rectangle
+	/*!
+	 * @param center center of the rectangle
+	 * @param u half-extent vector along the image x-axis
+	 * @param v half-extent vector along the image y-axis
+	 */
+	plane( const double center[3], const double u[3], const double v[3] )
+	{
+		for( int i=0; i<3; ++i ){
+			m_center[i] = center[i];
+			m_u[i] = u[i];
+			m_v[i] = v[i];
+		}
+	}
+
+	//! square perpendicular to a coordinate axis, image axes follow the cyclic order (y,z), (z,x), (x,y)
+	/*!
+	 * @param axis the normal axis (0=x, 1=y, 2=z)
+	 * @param center center of the square
+	 * @param half_width half the side length of the square
+	 */
+	static plane axis_aligned( int axis, const double center[3], double half_width )
+	{
+		if( axis < 0 || axis > 2 )
+			throw std::runtime_error("RAMSES::HYDRO::plane::axis_aligned : invalid axis.");
+		double u[3] = { 0.0, 0.0, 0.0 }, v[3] = { 0.0, 0.0, 0.0 };
+		u[(axis+1)%3] = half_width;
+		v[(axis+2)%3] = half_width;
+		return plane( center, u, v );
+	}
+
+	//! position of the center of pixel (i,j) of an nx*ny image, row 0 at the top
+	inline void pixel_pos( unsigned i, unsigned j, unsigned nx, unsigned ny, double p[3] ) const
+	{
+		double su = (2.0*i+1.0)/nx-1.0, sv = 1.0-(2.0*j+1.0)/ny;
+		for( int k=0; k<3; ++k )
+			p[k] = m_center[k] + su*m_u[k] + sv*m_v[k];
+	}
+};
+
+/**************************************************************************************\
+\**************************************************************************************/
+
+//! sample a hydro variable on a plane at the given pixel resolution
+/*! every pixel takes the value of the finest leaf cell containing its center. Rows are
+ *  processed in parallel; along a row the location path of the previous pixel is reused
+ *  and all following pixels that fall into the same leaf are filled without a lookup.
+ *  Only pixels inside leaves owned by the domain of the tree are written, so slices of
+ *  several domains can be accumulated into the same image. The levels of the leaves the
+ *  plane crosses that have not been read yet are loaded before the pixels are filled
+ *  (see load_touched_levels()).
+ * @param tree the AMR tree, must be built with son links (cell_locally_essential)
+ * @param var the hydro variable, any object providing cell_value( const cell_ref& )
+ * @param pl the plane section to be sampled
+ * @param nx number of pixels along the image x-axis
+ * @param ny number of pixels along the image y-axis
+ * @param image row-major nx*ny image, (re)initialized with fill if its size differs
+ * @param fill value for pixels not covered
+ */
+template< typename TreeType_, typename Data_, typename ValueType_ >
+void slice( const TreeType_& tree, Data_& var, const plane& pl, unsigned nx, unsigned ny,
+			std::vector<ValueType_>& image, ValueType_ fill=ValueType_(0) )
+{
+	if( image.size() != (size_t)nx*ny )
+		image.assign( (size_t)nx*ny, fill );
+
+	double step[3];
+	for( int k=0; k<3; ++k )
+		step[k] = 2.0*pl.m_u[k]/nx;
+
+	//... a run of pixels of a row within one owned leaf ...//
+	struct run{
+		RAMSES::AMR::cell_ref c;
+		unsigned i, n;
+	};
+	int nrows = (int)ny;
+	std::vector< std::vector<run> > runs( ny );
+
+	#pragma omp parallel for schedule(dynamic)
+	for( int j=0; j<nrows; ++j ){
+		std::vector<unsigned> path;
+		int depth = -1;
+
+		unsigned i = 0;
+		while( i < nx ){
+			double p[3];
+			pl.pixel_pos( i, j, nx, ny, p );
+			RAMSES::AMR::cell_ref c = tree.locate_cached( p, path, depth );
+			if( c.m_igrid == ENDPOINT ){
+				++i;
+				continue;
+			}
+
+			//... count the pixels of the row that stay within this leaf ...//
+			const typename TreeType_::cell_type& oct = tree.m_AMR_levels[c.m_ilevel].m_level_cells[c.m_igrid];
+			double hc = ldexp( 0.5, -(int)c.m_ilevel-1 );
+			double kexit = (double)(nx-i);
+			for( int k=0; k<3; ++k ){
+				double xc = oct.m_xg[k] + (((c.m_ind>>k)&1)? hc : -hc);
+				if( step[k] > 0.0 )
+					kexit = std::min( kexit, (xc+hc-p[k])/step[k] );
+				else if( step[k] < 0.0 )
+					kexit = std::min( kexit, (xc-hc-p[k])/step[k] );
+			}
+			unsigned nrun = std::max( 1u, (unsigned)std::min( std::floor(kexit), (double)(nx-i) ) );
+
+			if( (int)oct.m_cpu == tree.m_cpu ){
+				run r = { c, i, nrun };
+				runs[j].push_back( r );
+			}
+			i += nrun;
+		}
+	}
+
+	//... read the levels the plane reaches, then fill the pixels ...//
+	std::vector<char> touched( tree.m_AMR_levels.size(), 0 );
+	for( unsigned j=0; j<ny; ++j )
+		for( size_t k=0; k<runs[j].size(); ++k )
+			touched[runs[j][k].c.m_ilevel] = 1;
+	load_touched_levels( var, touched );
+
+	#pragma omp parallel for schedule(dynamic)
+	for( int j=0; j<nrows; ++j ){
+		ValueType_* row = &image[(size_t)j*nx];
+		for( size_t k=0; k<runs[j].size(); ++k ){
+			const run& r = runs[j][k];
+			if( level_loaded( var, r.c.m_ilevel ) )
+				std::fill( row+r.i, row+r.i+r.n, (ValueType_)var.cell_value( r.c ) );
+		}
+	}
+}
+
+//! sample a bundled multi-domain hydro variable on a plane
+/*!
+ * @param md the bundled hydro data, one tree per domain
+ * @param pl the plane section to be sampled
+ * @param nx number of pixels along the image x-axis
+ * @param ny number of pixels along the image y-axis
+ * @param image row-major nx*ny image, (re)initialized with fill if its size differs
+ * @param fill value for pixels not covered
+ */
+template< typename TreeType_, typename DataType_, typename ValueType_ >
+void slice( multi_domain_data<TreeType_,DataType_,ValueType_>& md, const plane& pl, unsigned nx, unsigned ny,
+			std::vector<ValueType_>& image, ValueType_ fill=ValueType_(0) )
+{
+	if( image.size() != (size_t)nx*ny )
+		image.assign( (size_t)nx*ny, fill );
+	for( unsigned idom=0; idom<md.m_data.size(); ++idom )
+		slice( *md.m_ptrees[idom], *md.m_data[idom], pl, nx, ny, image, fill );
+}
+
+} // namespace HYDRO
+} // namespace RAMSES
+
+#endif //__RAMSES_SLICE_HH
@@ -1,6 +1,15 @@
 // Std. Includes
 #include <string>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
 
 // GLEW
 #include <GL/glew.h>
@@ -12,10 +21,25 @@
 #include "Display.h"
 #include "Shader.h"
 #include "Camera.h"
-#include "RAMSES_Particle_Manager.h"
+#include "SnapshotPlayer.h"
 #include "AMRGridRenderer.h"
+#include "VolumeRenderer.h"
+#include "SplatRenderer.h"
+#include "SplatBuffer.h"
+#include "OffscreenContext.h"
+#include "ramses/RAMSES_catalog.hh"
 // Global pointer to allow key callback to toggle grid visibility
 static AMRGridRenderer* g_grid = nullptr;
+// Set by 'V'; the main loop renders the current view on the CPU and saves it
+static bool g_renderVolume = false;
+// Set by 'X'; the main loop splats the particles of the current view on the CPU and saves them
+static bool g_renderSplats = false;
+// Toggled by 'C'; tints particles by the gas density of their enclosing cell
+static bool g_colourByGas = false;
+// Snapshot playback, driven by Space and the arrow keys
+static SnapshotPlayer* g_player = nullptr;
+// Reduced-resolution splat accumulation, scaled with '[' and ']'
+static SplatBuffer* g_splatBuffer = nullptr;
 
 // GLM Mathemtics
 #include <glm/glm.hpp>
@@ -33,6 +57,38 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void Do_Movement();
+void renderVolume(const std::string& fname, const glm::mat4& view, const glm::mat4& projection);
+void renderSplats(const std::string& fname, const glm::mat4& view, const glm::mat4& projection);
+
+// Frame rendering shared by the window and the headless mode
+void setupRenderState();
+void syncGrid(std::unique_ptr<AMRGridRenderer>& grid, std::string& gridFile, const std::string& infoFile);
+glm::mat4 cameraProjection(int width, int height);
+SplatRenderer::Params splatParams(int height);
+void renderFrame(Shader& shader, const SnapshotPlayer& player, AMRGridRenderer* grid, SplatBuffer& splats,
+				 int width, int height, const glm::mat4& view, const glm::mat4& projection);
+
+// Options of the headless mode, see parseArguments()
+struct HeadlessOptions
+{
+	bool enabled = false;
+	int width = 1920, height = 1080;
+	std::string output = "frame_";
+	std::string format = "png";
+	bool grid = false;
+	// Render on the CPU without an OpenGL context
+	bool cpu = false;
+	// Hydro variable to volume render on the CPU instead of splatting the particles
+	std::string volume;
+	// Also render on the CPU and report the difference to the OpenGL frame
+	bool reference = false;
+	// Fraction of the output resolution the OpenGL splats accumulate at
+	float splatScale = 1.0f;
+};
+bool parseArguments(int argc, char** argv, std::string& fname, HeadlessOptions& headless);
+int runHeadless(const std::vector<std::string>& infoFiles, const HeadlessOptions& options);
+int runHeadlessCpu(const std::vector<std::string>& infoFiles, const HeadlessOptions& options);
+bool writeFrame(const Image& image, const HeadlessOptions& options, size_t index);
 
 // Camera
 Camera camera(glm::vec3(0.5f, 0.5f, 1.5f));
@@ -45,13 +101,37 @@ GLfloat lastFrame = 0.0f;
 const GLfloat POINT_SIZE = 6.0f;
 
 // The MAIN function, from here we start our application and run our Game loop
-int main()
+int main(int argc, char** argv)
 {
+	// The path is an info_XXXXX.txt file or a simulation directory with output_XXXXX folders
+	std::string fname = "C:\\Users\\dsull\\Downloads\\output_00101\\info_00101.txt";
+	HeadlessOptions headless;
+	if (!parseArguments(argc, argv, fname, headless))
+		return 1;
+	// Snapshots available for playback, in output order
+	std::vector<std::string> infoFiles(1, fname);
+	if (RAMSES::catalog::is_simulation_dir(fname))
+	{
+		RAMSES::catalog catalog(fname);
+		if (catalog.size() == 0)
+		{
+			std::cerr << "No readable snapshots in " << fname << std::endl;
+			return 1;
+		}
+		std::cout << "Found " << catalog.size() << " snapshots:" << std::endl;
+		for (size_t i = 0; i < catalog.size(); i++)
+			std::cout << "  " << catalog[i].info_fname << "  aexp = " << catalog[i].header.aexp
+					  << "  ncpu = " << catalog[i].header.ncpu << std::endl;
+		infoFiles.clear();
+		for (size_t i = 0; i < catalog.size(); i++)
+			infoFiles.push_back(catalog[i].info_fname);
+	}
+
+	if (headless.enabled)
+		return runHeadless(infoFiles, headless);
+
 	// Init GLFW
 	Display display(screenWidth, screenHeight, "ParticleViewer");
-
-	std::string fname = "C:\\Users\\dsull\\Downloads\\output_00101\\info_00101.txt";
-	RAMSES_Particle_Manager partManager(fname);
 	display.Create();
 
 	// Set the required callback functions
@@ -62,46 +142,24 @@ int main()
 	// Options
 	glfwSetInputMode(display.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	// Setup some OpenGL options
-	glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    // Additive blending to accumulate density contributions
-    glBlendFunc(GL_ONE, GL_ONE);
+	setupRenderState();
 
 	// Setup and compile our shaders
 	Shader ourShader("./resources/shaders/particle.vs", "./resources/shaders/particle.frag");
 
-	// Optional AMR grid renderer
-    AMRGridRenderer grid(fname);
-    grid.build(1, 5); // show a few levels; tune as needed
-    grid.setVisible(false);
-    g_grid = &grid;
-
-	GLfloat *vertices = partManager.particlesArray();
-
-	glEnable(GL_POINTS);
-	//glTexEnvi(GL_POINTS, GL_COORD_REPLACE, GL_TRUE);
-	//glEnable(GL_VERTEX_PROGRAM_POINT_SIZE_NV);
-	glPointSize(POINT_SIZE);
-
-	GLuint VBO, VAO;
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	// Bind our Vertex Array Object first, then bind and set our buffers and pointers.
-	glBindVertexArray(VAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	std::cout << "Preparing VBO" << std::endl;
-	//glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * partManager.mParticleArray.size(), vertices, GL_STATIC_DRAW);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * partManager.npartDraw, vertices, GL_STATIC_DRAW);
-	std::cout << "Successfully called glBufferData" << std::endl;
-	delete [] vertices;
+	// Loads the first snapshot now and prefetches the following ones in the background,
+	// velocities are read for interpolated playback when there is more than one snapshot.
+	// Gas is only sampled once particles are coloured by it
+	std::unique_ptr<SnapshotPlayer> player(new SnapshotPlayer(infoFiles, 0, g_colourByGas, infoFiles.size() > 1));
+	g_player = player.get();
 
-	// Position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
+	// Splats at full resolution until scaled down with '['
+	SplatBuffer splatBuffer;
+	g_splatBuffer = &splatBuffer;
 
-	glBindVertexArray(0); // Unbind VAO
+	// Optional AMR grid renderer, rebuilt for the current snapshot when shown
+	std::unique_ptr<AMRGridRenderer> grid;
+	std::string gridFile;
 
 	// Game loop
 	while (!display.ShouldClose())
@@ -115,59 +173,402 @@ int main()
 		glfwPollEvents();
 		Do_Movement();
 
-		// Clear the colorbuffer
-		glClearColor(0.02f, 0.02f, 0.03f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Draw our first triangle
-		ourShader.Use();
+		// The first 'C' reloads the snapshots with the gas of the particles
+		if (g_colourByGas && !player->withGas())
+		{
+			bool playing = player->isPlaying(), interpolating = player->isInterpolating();
+			size_t current = player->current();
+			g_player = nullptr;
+			player.reset();
+			player.reset(new SnapshotPlayer(infoFiles, current, true, infoFiles.size() > 1));
+			g_player = player.get();
+			if (playing)
+				player->togglePlay();
+			if (player->isInterpolating() != interpolating)
+				player->toggleInterpolation();
+		}
+		player->update(currentFrame);
+
+		syncGrid(grid, gridFile, player->currentFile());
+		g_grid = grid.get();
 
 		// Create camera transformation
-		glm::mat4 view;
-		view = camera.GetViewMatrix();
-		glm::mat4 projection;
-		projection = glm::perspective(camera.Zoom, (float)screenWidth / (float)screenHeight, 0.1f, 1000.0f);
-		// Get the uniform locations
-		GLint modelLoc = glGetUniformLocation(ourShader.Program, "model");
-		GLint viewLoc = glGetUniformLocation(ourShader.Program, "view");
-		GLint projLoc = glGetUniformLocation(ourShader.Program, "projection");
-        // Compute point scale from FOV and viewport height (approximate)
-        float fovRadians = camera.Zoom;
-        float pointScale = (float)screenHeight / (2.0f * tanf(fovRadians * 0.5f));
-        GLint baseSizeLoc = glGetUniformLocation(ourShader.Program, "uPointBaseSize");
-        GLint scaleLoc = glGetUniformLocation(ourShader.Program, "uPointScale");
-		glUniform1f(baseSizeLoc, POINT_SIZE);
-		glUniform1f(scaleLoc, pointScale);
-
-        // Density splat shader params
-        GLint sigmaLoc = glGetUniformLocation(ourShader.Program, "uSigma");
-        GLint intenLoc = glGetUniformLocation(ourShader.Program, "uIntensityScale");
-        glUniform1f(sigmaLoc, 4.0f);         // Gaussian width
-        glUniform1f(intenLoc, 0.03f);        // Overall brightness scale
-
-		// Pass the matrices to the shader
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-		glBindVertexArray(VAO);
-		// Draw all points directly from the VBO in one call
-		glm::mat4 model(1.0f);
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-		glDrawArrays(GL_POINTS, 0, partManager.npartDraw);
-		glBindVertexArray(0);
-
-        // Draw AMR grid if visible
-        grid.draw(view, projection);
+		glm::mat4 view = camera.GetViewMatrix();
+		glm::mat4 projection = cameraProjection(screenWidth, screenHeight);
+		renderFrame(ourShader, *player, grid.get(), splatBuffer, screenWidth, screenHeight, view, projection);
+
+		// CPU volume rendering of the gas density for the current view
+		if (g_renderVolume)
+		{
+			g_renderVolume = false;
+			renderVolume(player->currentFile(), view, projection);
+		}
+		// CPU splatting of the particles for the current view
+		if (g_renderSplats)
+		{
+			g_renderSplats = false;
+			renderSplats(player->currentFile(), view, projection);
+		}
 		// Swap the buffers
 		display.SwapBuffers();
 	}
-	// Properly de-allocate all resources once they've outlived their purpose
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
+	g_grid = nullptr;
+	g_player = nullptr;
+	g_splatBuffer = nullptr;
 	//glfwTerminate();  // Called in display destructor
 	return 0;
 }
 
+// Parses [--headless [--size WxH] [--output prefix] [--format png|ppm] [--grid] [--colour-by-gas]
+// [--cpu [--volume var] | --reference] [--splat-scale F]] [path]
+bool parseArguments(int argc, char** argv, std::string& fname, HeadlessOptions& headless)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless")
+			headless.enabled = true;
+		else if (arg == "--size" && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &headless.width, &headless.height) != 2 || headless.width <= 0 || headless.height <= 0)
+			{
+				std::cerr << "Invalid size " << argv[i] << ", expected WxH" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--output" && hasValue)
+			headless.output = argv[++i];
+		else if (arg == "--format" && hasValue)
+			headless.format = argv[++i];
+		else if (arg == "--grid")
+			headless.grid = true;
+		else if (arg == "--colour-by-gas")
+			g_colourByGas = true;
+		else if (arg == "--cpu")
+			headless.cpu = true;
+		else if (arg == "--volume" && hasValue)
+			headless.volume = argv[++i];
+		else if (arg == "--reference")
+			headless.reference = true;
+		else if (arg == "--splat-scale" && hasValue)
+		{
+			headless.splatScale = (float)atof(argv[++i]);
+			if (headless.splatScale < SplatBuffer::kMinScale || headless.splatScale > 1.0f)
+			{
+				std::cerr << "Invalid splat scale " << argv[i] << ", expected " << SplatBuffer::kMinScale << " to 1" << std::endl;
+				return false;
+			}
+		}
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			std::cerr << "Unknown option " << arg << std::endl;
+			return false;
+		}
+		else
+			fname = arg;
+	}
+	if (headless.cpu && headless.grid)
+	{
+		std::cerr << "--grid needs OpenGL and cannot be combined with --cpu" << std::endl;
+		return false;
+	}
+	if (!headless.volume.empty() && !headless.cpu)
+	{
+		std::cerr << "--volume renders on the CPU and needs --cpu" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Renders one frame per snapshot into an offscreen framebuffer and writes
+// <output>NNNNN.<format>, with the camera at its start position
+int runHeadless(const std::vector<std::string>& infoFiles, const HeadlessOptions& options)
+{
+	if (options.cpu)
+		return runHeadlessCpu(infoFiles, options);
+	try
+	{
+		OffscreenContext context(options.width, options.height);
+		std::cout << "Rendering offscreen with " << glGetString(GL_RENDERER) << std::endl;
+		setupRenderState();
+
+		Shader ourShader("./resources/shaders/particle.vs", "./resources/shaders/particle.frag");
+		SnapshotPlayer player(infoFiles, 0, g_colourByGas);
+		SplatBuffer splatBuffer;
+		splatBuffer.setScale(options.splatScale);
+		std::unique_ptr<AMRGridRenderer> grid;
+		std::string gridFile;
+		Image image;
+
+		for (size_t i = 0; i < infoFiles.size(); i++)
+		{
+			// The following snapshots are prefetched while the current one is rendered
+			if (i > 0)
+			{
+				player.step(1);
+				while (player.isLoading())
+				{
+					player.update(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+				if (player.current() != i)
+					return 1;
+			}
+
+			if (options.grid)
+			{
+				syncGrid(grid, gridFile, player.currentFile());
+				grid->setVisible(true);
+			}
+
+			glm::mat4 view = camera.GetViewMatrix();
+			glm::mat4 projection = cameraProjection(options.width, options.height);
+			renderFrame(ourShader, player, grid.get(), splatBuffer, options.width, options.height, view, projection);
+
+			context.readPixels(image);
+			if (!writeFrame(image, options, i))
+				return 1;
+
+			// Compare with the CPU splats, which round like the 8-bit framebuffer
+			if (options.reference)
+			{
+				SplatRenderer splats(player.currentFile(), g_colourByGas);
+				SplatRenderer::Params params = splatParams(options.height);
+				params.quantize = true;
+				Image reference(options.width, options.height);
+				splats.render(view, projection, params, reference);
+
+				int maxDiff = 0;
+				double sumDiff = 0.0;
+				for (size_t k = 0; k < image.data().size(); k++)
+				{
+					int diff = std::abs((int)image.data()[k] - (int)reference.data()[k]);
+					maxDiff = std::max(maxDiff, diff);
+					sumDiff += diff;
+				}
+				std::cout << "CPU reference: max difference " << maxDiff << ", mean "
+						  << sumDiff / image.data().size() << " (8-bit levels)" << std::endl;
+			}
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Headless rendering failed: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Splats the particles, or volume renders a hydro variable, of every snapshot on the CPU,
+// needs neither a display nor OpenGL
+int runHeadlessCpu(const std::vector<std::string>& infoFiles, const HeadlessOptions& options)
+{
+	try
+	{
+		Image image(options.width, options.height);
+		glm::mat4 view = camera.GetViewMatrix();
+		glm::mat4 projection = cameraProjection(options.width, options.height);
+		for (size_t i = 0; i < infoFiles.size(); i++)
+		{
+			if (!options.volume.empty())
+			{
+				VolumeRenderer volume(infoFiles[i]);
+				volume.build(options.volume, std::numeric_limits<unsigned>::max());
+				auto start = std::chrono::steady_clock::now();
+				volume.render(view, projection, image);
+				std::cout << "Volume rendered " << options.volume << " in "
+						  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+				if (!writeFrame(image, options, i))
+					return 1;
+				continue;
+			}
+
+			SplatRenderer splats(infoFiles[i], g_colourByGas);
+			auto start = std::chrono::steady_clock::now();
+			splats.render(view, projection, splatParams(options.height), image);
+			std::cout << "Splatted " << splats.size() << " particles in "
+					  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+			if (!writeFrame(image, options, i))
+				return 1;
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Headless rendering failed: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Writes <output>NNNNN.<format>
+bool writeFrame(const Image& image, const HeadlessOptions& options, size_t index)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%05d.", (int)index);
+	std::string path = options.output + name + options.format;
+	if (!image.write(path))
+	{
+		std::cerr << "Cannot write " << path << std::endl;
+		return false;
+	}
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
+
+// GL state for additive density splatting
+void setupRenderState()
+{
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	// Additive blending to accumulate density contributions
+	glBlendFunc(GL_ONE, GL_ONE);
+	// Point sizes come from particle.vs
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glPointSize(POINT_SIZE);
+}
+
+// (Re)builds the AMR grid for a snapshot it was not built for, while it is shown or
+// if it was never built
+void syncGrid(std::unique_ptr<AMRGridRenderer>& grid, std::string& gridFile, const std::string& infoFile)
+{
+	if ((grid && !grid->isVisible()) || gridFile == infoFile)
+		return;
+	bool visible = grid && grid->isVisible();
+	grid.reset(new AMRGridRenderer(infoFile));
+	// Load every level; draw() only shows octs in view that cover enough pixels
+	grid->build(1, std::numeric_limits<unsigned>::max());
+	grid->setVisible(visible);
+	gridFile = infoFile;
+}
+
+glm::mat4 cameraProjection(int width, int height)
+{
+	return glm::perspective(camera.Zoom, (float)width / (float)height, 0.1f, 1000.0f);
+}
+
+// Splat parameters for a viewport height, shared by particle.vs/particle.frag and SplatRenderer
+SplatRenderer::Params splatParams(int height)
+{
+	SplatRenderer::Params params;
+	params.pointBaseSize = POINT_SIZE;
+	// Compute point scale from FOV and viewport height (approximate)
+	params.pointScale = (float)height / (2.0f * tanf(camera.Zoom * 0.5f));
+	params.sigma = 4.0f;              // Gaussian width
+	params.intensityScale = 0.03f;    // Overall brightness scale
+	params.colourByGas = g_colourByGas;
+	params.background = glm::vec3(0.02f, 0.02f, 0.03f);
+	return params;
+}
+
+// Clears the bound framebuffer of size width x height and draws the particles, through
+// the splat buffer, and, if visible, the AMR grid
+void renderFrame(Shader& shader, const SnapshotPlayer& player, AMRGridRenderer* grid, SplatBuffer& splats,
+				 int width, int height, const glm::mat4& view, const glm::mat4& projection)
+{
+	SplatRenderer::Params params = splatParams(height);
+
+	// Clear the colorbuffer
+	glClearColor(params.background.x, params.background.y, params.background.z, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	int splatWidth, splatHeight;
+	splats.begin(width, height, splatWidth, splatHeight);
+
+	shader.Use();
+
+	// Get the uniform locations
+	GLint modelLoc = glGetUniformLocation(shader.Program, "model");
+	GLint viewLoc = glGetUniformLocation(shader.Program, "view");
+	GLint projLoc = glGetUniformLocation(shader.Program, "projection");
+	GLint baseSizeLoc = glGetUniformLocation(shader.Program, "uPointBaseSize");
+	GLint scaleLoc = glGetUniformLocation(shader.Program, "uPointScale");
+	glUniform1f(baseSizeLoc, params.pointBaseSize);
+	glUniform1f(scaleLoc, params.pointScale);
+	// Point sizes are clamped in output pixels, then shrunk to the splat resolution
+	glUniform1f(glGetUniformLocation(shader.Program, "uResolutionScale"), (float)splatHeight / height);
+
+	// Density splat shader params
+	GLint sigmaLoc = glGetUniformLocation(shader.Program, "uSigma");
+	GLint intenLoc = glGetUniformLocation(shader.Program, "uIntensityScale");
+	glUniform1f(sigmaLoc, params.sigma);
+	glUniform1f(intenLoc, params.intensityScale);
+	glUniform1i(glGetUniformLocation(shader.Program, "uColourByGas"), params.colourByGas ? 1 : 0);
+
+	// Pass the matrices to the shader
+	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+	// Draw all points of the current snapshot directly from its VBO in one call
+	glm::mat4 model(1.0f);
+	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	player.draw(shader.Program);
+	splats.end();
+
+	// Draw AMR grid if visible, always at full resolution
+	if (grid)
+		grid->draw(view, projection);
+}
+
+// Ray-marches the gas density on the CPU and writes volume_NNNN.png
+void renderVolume(const std::string& fname, const glm::mat4& view, const glm::mat4& projection)
+{
+	static std::unique_ptr<VolumeRenderer> volume;
+	static std::string volumeFile;
+	static int frame = 0;
+	try
+	{
+		if (!volume || volumeFile != fname)
+		{
+			volumeFile = fname;
+			volume.reset(new VolumeRenderer(fname));
+			volume->build("density", std::numeric_limits<unsigned>::max());
+		}
+		Image image(screenWidth, screenHeight);
+		double start = glfwGetTime();
+		volume->render(view, projection, image);
+		char name[32];
+		snprintf(name, sizeof(name), "volume_%04d.png", frame++);
+		image.write(name);
+		std::cout << "Volume rendering written to " << name << " in " << glfwGetTime() - start << " s" << std::endl;
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Volume rendering failed: " << e.what() << std::endl;
+		volume.reset();
+	}
+}
+
+// Splats the particles on the CPU and writes splat_NNNN.png
+void renderSplats(const std::string& fname, const glm::mat4& view, const glm::mat4& projection)
+{
+	static std::unique_ptr<SplatRenderer> splats;
+	static std::string splatsFile;
+	static bool splatsGas = false;
+	static int frame = 0;
+	try
+	{
+		if (!splats || splatsFile != fname || (g_colourByGas && !splatsGas))
+		{
+			splatsFile = fname;
+			splatsGas = g_colourByGas;
+			splats.reset(new SplatRenderer(fname, splatsGas));
+		}
+		Image image(screenWidth, screenHeight);
+		double start = glfwGetTime();
+		splats->render(view, projection, splatParams(screenHeight), image);
+		char name[32];
+		snprintf(name, sizeof(name), "splat_%04d.png", frame++);
+		image.write(name);
+		std::cout << "CPU splats written to " << name << " in " << glfwGetTime() - start << " s" << std::endl;
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "CPU splat rendering failed: " << e.what() << std::endl;
+		splats.reset();
+	}
+}
+
 // Moves/alters the camera positions based on user input
 void Do_Movement()
 {
@@ -203,6 +604,38 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         if (g_grid) g_grid->setVisible(!g_grid->isVisible());
     }
 
+	// Volume render the current view on the CPU with 'V'
+	if (key == GLFW_KEY_V && action == GLFW_PRESS)
+		g_renderVolume = true;
+
+	// Splat the particles of the current view on the CPU with 'X'
+	if (key == GLFW_KEY_X && action == GLFW_PRESS)
+		g_renderSplats = true;
+
+	// Colour particles by ambient gas density with 'C'
+	if (key == GLFW_KEY_C && action == GLFW_PRESS)
+		g_colourByGas = !g_colourByGas;
+
+	// Snapshot playback: Space plays/pauses, the arrow keys step one snapshot
+	if (g_player && action == GLFW_PRESS)
+	{
+		if (key == GLFW_KEY_SPACE)
+			g_player->togglePlay();
+		else if (key == GLFW_KEY_RIGHT)
+			g_player->step(1);
+		else if (key == GLFW_KEY_LEFT)
+			g_player->step(-1);
+		else if (key == GLFW_KEY_I)
+			g_player->toggleInterpolation();
+	}
+
+	// Splat resolution: '[' lowers it, ']' raises it, in quarters of the window resolution
+	if (g_splatBuffer && action == GLFW_PRESS && (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET))
+	{
+		g_splatBuffer->setScale(g_splatBuffer->scale() + (key == GLFW_KEY_RIGHT_BRACKET ? 0.25f : -0.25f));
+		std::cout << "Splat resolution " << g_splatBuffer->scale() * 100.0f << "% of the window" << std::endl;
+	}
+
 	if (action == GLFW_PRESS)
 		keys[key] = true;
 	else if (action == GLFW_RELEASE)
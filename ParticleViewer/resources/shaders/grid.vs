@@ -1,9 +1,12 @@
 #version 330 core
-layout (location = 0) in vec3 position;
+layout (location = 0) in vec3 position; // unit cube corner in [-1,1]^3
+layout (location = 1) in vec4 aOct;     // per instance: oct centre (xyz), tree level (w)
 
 uniform mat4 view;
 uniform mat4 projection;
 
 void main() {
-  gl_Position = projection * view * vec4(position, 1.0);
+  // an oct on tree level l spans 0.5^l of the box, i.e. half-size 0.5^(l+1)
+  float halfSize = exp2(-(aOct.w + 1.0));
+  gl_Position = projection * view * vec4(aOct.xyz + position * halfSize, 1.0);
 }
@@ -1,10 +1,12 @@
 
 #version 330 core
 in float vIntensity;
+in float vGas;
 out vec4 fragColor;
 
 uniform float uSigma;            // gaussian width (higher = tighter core)
 uniform float uIntensityScale;   // overall brightness scale for additive blending
+uniform bool uColourByGas;       // tint by ambient gas density instead of white
 
 // Additive Gaussian splat for density accumulation
 void main()
@@ -18,8 +20,13 @@ void main()
     float weight = exp(-r2 * uSigma);
     float intensity = vIntensity * weight * uIntensityScale;
 
-    // Accumulate as near-white (slightly cool tint)
-    vec3 col = vec3(0.85, 0.9, 1.0) * intensity;
+    // Accumulate as near-white (slightly cool tint), or ramp by ambient gas density
+    vec3 tint = vec3(0.85, 0.9, 1.0);
+    if (uColourByGas && vGas >= 0.0)
+        tint = vec3(min(1.0, 3.0 * vGas),
+                    clamp(3.0 * vGas - 1.0, 0.0, 1.0),
+                    clamp(3.0 * vGas - 2.0, 0.0, 1.0) * 0.8 + 0.2 * vGas);
+    vec3 col = tint * intensity;
     fragColor = vec4(col, 1.0);
 }
 
@@ -1,26 +1,47 @@
 #version 330 core
 layout (location = 0) in vec3 position;
+layout (location = 1) in float gasValue; // log gas density scaled to [0,1], -1 if none
+// Motion towards the next snapshot, only read when uMotionT > 0
+layout (location = 2) in vec3 target;    // position in the next snapshot, unwrapped
+layout (location = 3) in vec3 tangent0;  // velocity times snapshot interval, this snapshot
+layout (location = 4) in vec3 tangent1;  // velocity times snapshot interval, next snapshot
 
 out float vIntensity;
+out float vGas;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform float uPointBaseSize; // base sprite size in pixels at unit distance
 uniform float uPointScale;    // pixel scale factor (depends on FOV and viewport)
+uniform float uResolutionScale; // render target resolution relative to the output
+uniform float uMotionT;       // fraction of the way to the next snapshot
+uniform float uBoxLen;        // periodic box length
 
 void main()
 {
-    vec4 posEye4 = view * model * vec4(position, 1.0);
+    // Cubic Hermite interpolation, wrapped back into the periodic box
+    vec3 p = position;
+    if (uMotionT > 0.0)
+    {
+        float t = uMotionT, t2 = t * t, t3 = t2 * t;
+        p = (2.0 * t3 - 3.0 * t2 + 1.0) * position + (t3 - 2.0 * t2 + t) * tangent0
+          + (-2.0 * t3 + 3.0 * t2) * target + (t3 - t2) * tangent1;
+        p -= uBoxLen * floor(p / uBoxLen);
+    }
+
+    vec4 posEye4 = view * model * vec4(p, 1.0);
     vec3 posEye = posEye4.xyz;
     float dist = max(0.0001, length(posEye));
 
-    // Projected size attenuation by distance
+    // Projected size attenuation by distance, in output pixels
     float pointSize = clamp(uPointBaseSize * (uPointScale / dist), 1.0, 64.0);
-    gl_PointSize = pointSize;
+    gl_PointSize = pointSize * uResolutionScale;
 
     // Simple intensity falloff with distance for coloring
     vIntensity = clamp(1.0 / (0.1 + 0.3 * dist), 0.0, 1.0);
 
+    vGas = gasValue;
+
     gl_Position = projection * vec4(posEye, 1.0);
 }
\ No newline at end of file
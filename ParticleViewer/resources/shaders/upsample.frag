@@ -0,0 +1,30 @@
+#version 330 core
+in vec2 vTexCoord;
+out vec4 fragColor;
+
+uniform sampler2D uSplats; // splats accumulated at reduced resolution, linear filtering
+
+// Bicubic B-spline upsampling in four bilinear fetches instead of sixteen
+// point fetches. The B-spline never overshoots, so no negative density
+// appears around bright splats.
+void main() {
+  vec2 size = vec2(textureSize(uSplats, 0));
+  vec2 coord = vTexCoord * size - 0.5;
+  vec2 base = floor(coord);
+  vec2 f = coord - base;
+
+  vec2 f2 = f * f, f3 = f2 * f;
+  vec2 w0 = (1.0 - 3.0 * f + 3.0 * f2 - f3) / 6.0;
+  vec2 w1 = (4.0 - 6.0 * f2 + 3.0 * f3) / 6.0;
+  vec2 w2 = (1.0 + 3.0 * f + 3.0 * f2 - 3.0 * f3) / 6.0;
+  vec2 w3 = f3 / 6.0;
+
+  // Each pair of texels is one bilinear fetch between their centres
+  vec2 g0 = w0 + w1, g1 = w2 + w3;
+  vec2 h0 = (base - 0.5 + w1 / g0) / size;
+  vec2 h1 = (base + 1.5 + w3 / g1) / size;
+
+  vec3 col = g0.y * (g0.x * texture(uSplats, vec2(h0.x, h0.y)).rgb + g1.x * texture(uSplats, vec2(h1.x, h0.y)).rgb)
+           + g1.y * (g0.x * texture(uSplats, vec2(h0.x, h1.y)).rgb + g1.x * texture(uSplats, vec2(h1.x, h1.y)).rgb);
+  fragColor = vec4(col, 1.0);
+}
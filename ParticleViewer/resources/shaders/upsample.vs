@@ -0,0 +1,9 @@
+#version 330 core
+// Full-screen triangle generated from gl_VertexID, no vertex buffer needed
+out vec2 vTexCoord;
+
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  vTexCoord = p;
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
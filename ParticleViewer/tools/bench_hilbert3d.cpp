@@ -0,0 +1,125 @@
+/*
+	bench_hilbert3d.cpp
+	Microbenchmark and consistency check for RAMSES::hilbert3d_keys
+
+	Compares the table-driven hilbert key computation against the original
+	bit-by-bit implementation, which is reproduced below, and measures the
+	throughput of both.
+
+	Build (from the ParticleViewer directory):
+	  g++ -O2 -fopenmp -Iinclude/ramses tools/bench_hilbert3d.cpp -o bench_hilbert3d
+	  cl /O2 /openmp /EHsc /Iinclude\ramses tools\bench_hilbert3d.cpp
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+#include "RAMSES_info.hh"
+
+//! the original implementation of RAMSES::hilbert3d, for reference
+static void hilbert3d_reference( unsigned npoints, const int* x, const int* y, const int* z,
+								 double* order, unsigned bit_length )
+{
+	std::vector<bool> i_bit_mask(3*bit_length, false );
+	std::vector<bool> x_bit_mask(1*bit_length, false );
+	std::vector<bool> y_bit_mask(1*bit_length, false );
+	std::vector<bool> z_bit_mask(1*bit_length, false );
+
+	for( unsigned ip=0; ip<npoints; ++ip )
+	{
+		for( unsigned i=0; i<bit_length; ++i )
+		{
+			x_bit_mask[i] = (x[ip] & (1<<i)) != 0;
+			y_bit_mask[i] = (y[ip] & (1<<i)) != 0;
+			z_bit_mask[i] = (z[ip] & (1<<i)) != 0;
+		}
+
+		for( unsigned i=0; i<bit_length; ++i )
+		{
+			i_bit_mask[3*i+2] = x_bit_mask[i];
+			i_bit_mask[3*i+1] = y_bit_mask[i];
+			i_bit_mask[3*i+0] = z_bit_mask[i];
+		}
+
+		int nstate, cstate = 0;
+		for( int i=bit_length-1; i>=0; --i )
+		{
+			int sdigit = i_bit_mask[3*i+2]*4+i_bit_mask[3*i+1]*2+i_bit_mask[3*i+0];
+			nstate = RAMSES::state_diagram[cstate][0][sdigit];
+			int hdigit = RAMSES::state_diagram[cstate][1][sdigit];
+
+			i_bit_mask[3*i+2] = (hdigit & 4) != 0;
+			i_bit_mask[3*i+1] = (hdigit & 2) != 0;
+			i_bit_mask[3*i+0] = (hdigit & 1) != 0;
+
+			cstate = nstate;
+		}
+
+		order[ip] = 0.0;
+		for( unsigned i=0; i<3*bit_length; ++i )
+			order[ip] += (double)(i_bit_mask[i]*(1<<i));
+	}
+}
+
+static double seconds_since( std::chrono::steady_clock::time_point t0 )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now()-t0 ).count();
+}
+
+int main( int argc, char** argv )
+{
+	size_t npoints = argc > 1 ? (size_t)atol( argv[1] ) : 4000000;
+
+	std::vector<int> x( npoints ), y( npoints ), z( npoints );
+	std::vector<unsigned long long> keys( npoints );
+	std::vector<double> order( npoints );
+
+	//... the reference accumulates 1<<i in an int, so it is only exact up to 10 bits ...//
+	size_t nmismatch = 0;
+	for( unsigned bit_length=1; bit_length<=10; ++bit_length ){
+		srand( bit_length );
+		for( size_t i=0; i<npoints; ++i ){
+			x[i] = rand() & ((1<<bit_length)-1);
+			y[i] = rand() & ((1<<bit_length)-1);
+			z[i] = rand() & ((1<<bit_length)-1);
+		}
+		size_t ncheck = std::min( npoints, (size_t)200000 );
+		hilbert3d_reference( (unsigned)ncheck, &x[0], &y[0], &z[0], &order[0], bit_length );
+		RAMSES::hilbert3d_keys( ncheck, &x[0], &y[0], &z[0], &keys[0], bit_length );
+		for( size_t i=0; i<ncheck; ++i )
+			if( (double)keys[i] != order[i] )
+				++nmismatch;
+	}
+	printf("consistency check against reference: %s (%lu mismatches)\n", nmismatch? "FAILED" : "ok", (unsigned long)nmismatch );
+
+	const unsigned bit_length = 10;
+	for( size_t i=0; i<npoints; ++i ){
+		x[i] = rand() & ((1<<bit_length)-1);
+		y[i] = rand() & ((1<<bit_length)-1);
+		z[i] = rand() & ((1<<bit_length)-1);
+	}
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	hilbert3d_reference( (unsigned)npoints, &x[0], &y[0], &z[0], &order[0], bit_length );
+	double tref = seconds_since( t0 );
+
+	t0 = std::chrono::steady_clock::now();
+	RAMSES::hilbert3d( (unsigned)npoints, &x[0], &y[0], &z[0], &order[0], bit_length );
+	double tcompat = seconds_since( t0 );
+
+	//... warm up the thread pool before timing the batched version ...//
+	RAMSES::hilbert3d_keys( npoints, &x[0], &y[0], &z[0], &keys[0], bit_length );
+
+	t0 = std::chrono::steady_clock::now();
+	RAMSES::hilbert3d_keys( npoints, &x[0], &y[0], &z[0], &keys[0], bit_length );
+	double tkeys = seconds_since( t0 );
+
+	printf("%lu points, %u bits per coordinate\n", (unsigned long)npoints, bit_length );
+	printf("  reference      : %8.3f s  %10.2f Mkeys/s\n", tref, 1e-6*npoints/tref );
+	printf("  hilbert3d      : %8.3f s  %10.2f Mkeys/s\n", tcompat, 1e-6*npoints/tcompat );
+	printf("  hilbert3d_keys : %8.3f s  %10.2f Mkeys/s\n", tkeys, 1e-6*npoints/tkeys );
+
+	return nmismatch ? 1 : 0;
+}